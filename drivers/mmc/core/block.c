@@ -141,6 +141,9 @@ struct mmc_blk_data {
 #define MMC_BLK_PART_INVALID	UINT_MAX	/* Unknown partition active */
 	int	area_type;
 
+	/* First sector of the window, for MMC_BLK_DATA_AREA_ENH */
+	sector_t	start_sect;
+
 	/* debugfs files (only in main mmc_blk_data) */
 	struct dentry *status_dentry;
 	struct dentry *ext_csd_dentry;
@@ -177,12 +180,23 @@ static DEFINE_MUTEX(open_lock);
 module_param(perdev_minors, int, 0444);
 MODULE_PARM_DESC(perdev_minors, "Minors numbers to allocate per device");
 
+static bool enhanced_area;
+module_param(enhanced_area, bool, 0444);
+MODULE_PARM_DESC(enhanced_area, "Expose the eMMC enhanced user area as mmcblkXenh");
+
 static inline int mmc_blk_part_switch(struct mmc_card *card,
 				      unsigned int part_type);
 static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
 			       struct mmc_card *card,
 			       int recovery_mode,
 			       struct mmc_queue *mq);
+
+/* Card address of a request, in 512 byte sectors */
+static inline sector_t mmc_blk_rq_pos(struct mmc_blk_data *md,
+				      struct request *req)
+{
+	return md->start_sect + blk_rq_pos(req);
+}
 static void mmc_blk_hsq_req_done(struct mmc_request *mrq);
 
 static struct mmc_blk_data *mmc_blk_get(struct gendisk *disk)
@@ -1118,7 +1132,7 @@ static void mmc_blk_issue_erase_rq(struct mmc_queue *mq, struct request *req,
 		goto fail;
 	}
 
-	from = blk_rq_pos(req);
+	from = mmc_blk_rq_pos(md, req);
 	nr = blk_rq_sectors(req);
 
 	do {
@@ -1173,7 +1187,7 @@ static void mmc_blk_issue_secdiscard_rq(struct mmc_queue *mq,
 		goto out;
 	}
 
-	from = blk_rq_pos(req);
+	from = mmc_blk_rq_pos(md, req);
 	nr = blk_rq_sectors(req);
 
 	if (mmc_can_trim(card) && !mmc_erase_group_aligned(card, from, nr))
@@ -1354,7 +1368,7 @@ static void mmc_blk_data_prep(struct mmc_queue *mq, struct mmc_queue_req *mqrq,
 
 	brq->data.blksz = 512;
 	brq->data.blocks = blk_rq_sectors(req);
-	brq->data.blk_addr = blk_rq_pos(req);
+	brq->data.blk_addr = mmc_blk_rq_pos(md, req);
 
 	/*
 	 * The command queue supports 2 priorities: "high" (1) and "simple" (0).
@@ -1573,6 +1587,116 @@ static int mmc_blk_cqe_issue_flush(struct mmc_queue *mq, struct request *req)
 	return mmc_blk_cqe_start_req(mq->card->host, mrq);
 }
 
+/*
+ * Upper bound on the sectors erased by one CMD35/36/38 sequence issued via
+ * DCMD. Larger discards are done in passes, with the remainder requeued
+ * MMC_CQE_DISCARD_GAP_MS later, so that requests queued meanwhile are
+ * dispatched between passes instead of after the whole range.
+ */
+#define MMC_CQE_DISCARD_SECTORS	(64 * 1024)
+#define MMC_CQE_DISCARD_GAP_MS	1
+
+static void mmc_blk_cqe_dcmd_done(struct mmc_request *mrq)
+{
+	complete(&mrq->completion);
+}
+
+static int mmc_blk_cqe_wait_dcmd(struct mmc_host *host,
+				 struct mmc_queue_req *mqrq, struct request *req,
+				 u32 opcode, u32 arg, unsigned int flags,
+				 unsigned int busy_timeout)
+{
+	struct mmc_request *mrq = mmc_blk_cqe_prep_dcmd(mqrq, req);
+	int err;
+
+	mrq->cmd->opcode = opcode;
+	mrq->cmd->arg = arg;
+	mrq->cmd->flags = flags;
+	mrq->cmd->busy_timeout = busy_timeout;
+	mrq->done = mmc_blk_cqe_dcmd_done;
+	mrq->recovery_notifier = mmc_cqe_recovery_notifier;
+	init_completion(&mrq->completion);
+
+	err = mmc_cqe_start_req(host, mrq);
+	if (err)
+		return err;
+
+	wait_for_completion(&mrq->completion);
+	mmc_cqe_post_req(host, mrq);
+
+	return mrq->cmd->error;
+}
+
+/*
+ * Issue a discard as a sequence of direct commands. The CQE sends each DCMD
+ * with the queue barrier set, so tasks already queued are completed by the
+ * controller without halting it, and mq->busy keeps new tasks out until the
+ * erase sequence is done. That avoids draining the queue from software and
+ * switching the CQE off and on again around every discard.
+ */
+static enum mmc_issued mmc_blk_cqe_issue_discard(struct mmc_queue *mq,
+						 struct request *req)
+{
+	struct mmc_queue_req *mqrq = req_to_mmc_queue_req(req);
+	struct mmc_blk_data *md = mq->blkdata;
+	struct mmc_card *card = md->queue.card;
+	struct mmc_host *host = card->host;
+	unsigned int from, to, nr, busy_timeout;
+	int err;
+
+	from = mmc_blk_rq_pos(md, req);
+	nr = min_t(unsigned int, blk_rq_sectors(req), MMC_CQE_DISCARD_SECTORS);
+
+	/*
+	 * The CQE can't poll for busy after a DCMD, so the erase has to finish
+	 * within the host's busy timeout. mmc_cqe_can_dcmd_discard() made sure
+	 * a single erase group does.
+	 */
+	busy_timeout = mmc_erase_busy_timeout(card, card->erase_arg, from, nr);
+	while (host->max_busy_timeout && busy_timeout > host->max_busy_timeout &&
+	       nr > 1) {
+		nr /= 2;
+		busy_timeout = mmc_erase_busy_timeout(card, card->erase_arg,
+						      from, nr);
+	}
+	to = from + nr - 1;
+
+	if (!mmc_card_blockaddr(card)) {
+		from <<= 9;
+		to <<= 9;
+	}
+
+	err = mmc_blk_cqe_wait_dcmd(host, mqrq, req, MMC_ERASE_GROUP_START,
+				    from, MMC_RSP_R1 | MMC_CMD_AC, 0);
+	if (!err)
+		err = mmc_blk_cqe_wait_dcmd(host, mqrq, req,
+					    MMC_ERASE_GROUP_END, to,
+					    MMC_RSP_R1 | MMC_CMD_AC, 0);
+	if (!err)
+		err = mmc_blk_cqe_wait_dcmd(host, mqrq, req, MMC_ERASE,
+					    card->erase_arg,
+					    MMC_RSP_R1B | MMC_CMD_AC,
+					    busy_timeout);
+	if (err == -EBUSY)
+		return MMC_REQ_BUSY;
+
+	if (err) {
+		pr_debug("%s: CQE discard failed, error %d\n",
+			 md->disk->disk_name, err);
+		if (mqrq->retries++ < MMC_CQE_RETRIES)
+			blk_mq_requeue_request(req, true);
+		else
+			blk_mq_end_request(req, BLK_STS_IOERR);
+	} else if (blk_update_request(req, BLK_STS_OK, nr << 9)) {
+		blk_mq_requeue_request(req, false);
+		blk_mq_delay_kick_requeue_list(req->q, MMC_CQE_DISCARD_GAP_MS);
+	} else {
+		__blk_mq_end_request(req, BLK_STS_OK);
+	}
+
+	return MMC_REQ_FINISHED;
+}
+
 static int mmc_blk_hsq_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 {
 	struct mmc_queue_req *mqrq = req_to_mmc_queue_req(req);
@@ -1603,6 +1727,18 @@ static int mmc_blk_cqe_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 	return mmc_blk_cqe_start_req(mq->card->host, &mqrq->brq.mrq);
 }
 
+/*
+ * Steer filesystem metadata into the context opened by mmc_open_contexts(),
+ * away from bulk data written without a context. Context 0 means no context.
+ */
+static u32 mmc_blk_context_id(struct mmc_card *card, struct request *req)
+{
+	if (!card->ext_csd.nr_contexts || rq_data_dir(req) != WRITE)
+		return 0;
+
+	return (req->cmd_flags & REQ_META) ? 1 : 0;
+}
+
 static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
 			       struct mmc_card *card,
 			       int recovery_mode,
@@ -1614,6 +1750,7 @@ static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
 	struct mmc_blk_data *md = mq->blkdata;
 	bool do_rel_wr, do_data_tag;
 	bool do_multi;
+	u32 context_id = 0;
 
 	do_multi = (card->uhs2_state & MMC_UHS2_INITIALIZED) ? true : false;
 
@@ -1621,7 +1758,7 @@ static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
 
 	brq->mrq.cmd = &brq->cmd;
 
-	brq->cmd.arg = blk_rq_pos(req);
+	brq->cmd.arg = mmc_blk_rq_pos(md, req);
 	if (!mmc_card_blockaddr(card))
 		brq->cmd.arg <<= 9;
 	brq->cmd.flags = MMC_RSP_SPI_R1 | MMC_RSP_R1 | MMC_CMD_ADTC;
@@ -1661,13 +1798,17 @@ static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
 	 * We'll avoid using CMD23-bounded multiblock writes for
 	 * these, while retaining features like reliable writes.
 	 */
+	if (!do_rel_wr)
+		context_id = mmc_blk_context_id(card, req);
+
 	if ((md->flags & MMC_BLK_CMD23) && mmc_op_multi(brq->cmd.opcode) &&
 	    (do_rel_wr || !(card->quirks & MMC_QUIRK_BLK_NO_CMD23) ||
-	     do_data_tag)) {
+	     do_data_tag || context_id)) {
 		brq->sbc.opcode = MMC_SET_BLOCK_COUNT;
 		brq->sbc.arg = brq->data.blocks |
 			(do_rel_wr ? (1 << 31) : 0) |
-			(do_data_tag ? (1 << 29) : 0);
+			(do_data_tag ? (1 << 29) : 0) |
+			(context_id << 25);
 		brq->sbc.flags = MMC_RSP_R1 | MMC_CMD_AC;
 		brq->mrq.sbc = &brq->sbc;
 	}
@@ -2380,6 +2521,9 @@ enum mmc_issued mmc_blk_mq_issue_rq(struct mmc_queue *mq, struct request *req)
 		}
 		return MMC_REQ_FINISHED;
 	case MMC_ISSUE_DCMD:
+		if (req_op(req) == REQ_OP_DISCARD)
+			return mmc_blk_cqe_issue_discard(mq, req);
+		fallthrough;
 	case MMC_ISSUE_ASYNC:
 		switch (req_op(req)) {
 		case REQ_OP_FLUSH:
@@ -2452,6 +2596,8 @@ static struct mmc_blk_data *mmc_blk_alloc_req(struct mmc_card *card,
 	}
 
 	md->area_type = area_type;
+	if (area_type == MMC_BLK_DATA_AREA_ENH)
+		md->start_sect = card->ext_csd.enhanced_area_offset >> 9;
 
 	/*
 	 * Set the read-only status based on the supported commands
@@ -2480,7 +2626,8 @@ static struct mmc_blk_data *mmc_blk_alloc_req(struct mmc_card *card,
 	md->disk->private_data = md;
 	md->parent = parent;
 	set_disk_ro(md->disk, md->read_only || default_ro);
-	if (area_type & (MMC_BLK_DATA_AREA_RPMB | MMC_BLK_DATA_AREA_BOOT))
+	if (area_type & (MMC_BLK_DATA_AREA_RPMB | MMC_BLK_DATA_AREA_BOOT |
+			 MMC_BLK_DATA_AREA_ENH))
 		md->disk->flags |= GENHD_FL_NO_PART;
 
 	/*
@@ -2780,6 +2927,21 @@ static int mmc_blk_alloc_parts(struct mmc_card *card, struct mmc_blk_data *md)
 		}
 	}
 
+	/*
+	 * The enhanced (e.g. pSLC) area lives inside the user area and needs
+	 * no partition switch. Expose it as a window onto the user area with
+	 * its own queue and I/O statistics, so hot data can be placed there
+	 * explicitly.
+	 */
+	if (enhanced_area && card->ext_csd.enhanced_area_size &&
+	    card->ext_csd.enhanced_area_size != (unsigned int)-EINVAL) {
+		ret = mmc_blk_alloc_part(card, md, 0,
+			(sector_t)card->ext_csd.enhanced_area_size << 1,
+			false, "enh", MMC_BLK_DATA_AREA_ENH);
+		if (ret)
+			return ret;
+	}
+
 	return 0;
 }
 
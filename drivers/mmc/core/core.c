@@ -1449,6 +1449,7 @@ void _mmc_detect_change(struct mmc_host *host, unsigned long delay, bool cd_irq)
 		__pm_wakeup_event(host->ws, 5000);
 
 	host->detect_change = 1;
+	WRITE_ONCE(host->cd_gen, host->cd_gen + 1);
 	mmc_schedule_delayed_work(&host->detect, delay);
 }
 
@@ -1621,6 +1622,32 @@ static unsigned int mmc_erase_timeout(struct mmc_card *card,
 		return mmc_mmc_erase_timeout(card, arg, qty);
 }
 
+/* Number of erase groups, or SD write blocks, touched by @from .. @to */
+static unsigned int mmc_erase_qty(struct mmc_card *card, unsigned int from,
+				  unsigned int to)
+{
+	if (card->erase_shift)
+		return ((to >> card->erase_shift) -
+			(from >> card->erase_shift)) + 1;
+	else if (mmc_card_sd(card))
+		return to - from + 1;
+	else
+		return ((to / card->erase_size) -
+			(from / card->erase_size)) + 1;
+}
+
+/*
+ * Busy timeout of erasing @nr sectors from @from with @arg, for callers that
+ * send the erase sequence themselves, like the CQE direct command path.
+ */
+unsigned int mmc_erase_busy_timeout(struct mmc_card *card, unsigned int arg,
+				    unsigned int from, unsigned int nr)
+{
+	return mmc_erase_timeout(card, arg, mmc_erase_qty(card, from,
+							  from + nr - 1));
+}
+EXPORT_SYMBOL(mmc_erase_busy_timeout);
+
 static int mmc_do_erase(struct mmc_card *card, unsigned int from,
 			unsigned int to, unsigned int arg)
 {
@@ -1647,14 +1674,7 @@ static int mmc_do_erase(struct mmc_card *card, unsigned int from,
 	 * lost since the secure trim 1 commands occurred, it is generally
 	 * impossible to calculate the secure trim 2 timeout correctly.
 	 */
-	if (card->erase_shift)
-		qty += ((to >> card->erase_shift) -
-			(from >> card->erase_shift)) + 1;
-	else if (mmc_card_sd(card))
-		qty += to - from + 1;
-	else
-		qty += ((to / card->erase_size) -
-			(from / card->erase_size)) + 1;
+	qty += mmc_erase_qty(card, from, to);
 
 	if (!mmc_card_blockaddr(card)) {
 		from <<= 9;
@@ -2125,6 +2145,36 @@ out:
 	return -EIO;
 }
 
+/*
+ * An SD express card is recognised from its response to CMD8 alone, so on
+ * hosts that support it probe for one before anything else. This skips the
+ * UHS-II attempt, the eMMC hardware reset and the SDIO reset, which only add
+ * latency before the card is handed over to PCIe/NVMe. Any other card falls
+ * through to the regular probing sequence.
+ */
+static bool mmc_rescan_sd_express(struct mmc_host *host)
+{
+	int i;
+
+	if (!(host->caps2 & MMC_CAP2_SD_EXP) || (host->caps2 & MMC_CAP2_NO_SD))
+		return false;
+
+	for (i = 0; i < ARRAY_SIZE(freqs) - 1; i++)
+		if (freqs[i] <= host->f_max)
+			break;
+	host->f_init = max(min(freqs[i], host->f_max), host->f_min);
+
+	mmc_power_up(host, host->ocr_avail);
+	mmc_go_idle(host);
+
+	if (mmc_send_if_cond_pcie(host, host->ocr_avail)) {
+		mmc_power_off(host);
+		return false;
+	}
+
+	return mmc_card_sd_express(host);
+}
+
 int _mmc_detect_card_removed(struct mmc_host *host)
 {
 	int ret;
@@ -2272,6 +2322,11 @@ void mmc_rescan(struct work_struct *work)
 		goto out;
 	}
 
+	if (mmc_rescan_sd_express(host)) {
+		mmc_release_host(host);
+		goto out;
+	}
+
 	/*
 	 * Ideally we should favor initialization of legacy SD cards and defer
 	 * UHS-II enumeration. However, it seems like cards doesn't reliably
@@ -112,6 +112,8 @@ int mmc_can_secure_erase_trim(struct mmc_card *card);
 int mmc_erase_group_aligned(struct mmc_card *card, unsigned int from,
 			unsigned int nr);
 unsigned int mmc_calc_max_discard(struct mmc_card *card);
+unsigned int mmc_erase_busy_timeout(struct mmc_card *card, unsigned int arg,
+				    unsigned int from, unsigned int nr);
 
 int mmc_set_blocklen(struct mmc_card *card, unsigned int blocklen);
 
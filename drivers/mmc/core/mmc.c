@@ -8,6 +8,7 @@
  */
 
 #include <linux/err.h>
+#include <linux/moduleparam.h>
 #include <linux/of.h>
 #include <linux/slab.h>
 #include <linux/stat.h>
@@ -31,6 +32,17 @@
 #define DEFAULT_CMD6_TIMEOUT_MS	500
 #define MIN_CACHE_EN_TIMEOUT_MS 1600
 #define CACHE_FLUSH_TIMEOUT_MS 30000 /* 30s */
+#define MMC_NR_CONTEXTS		1 /* Metadata, see mmc_blk_context_id() */
+
+/*
+ * Leaving 512 byte emulation changes the logical block size of the device,
+ * which invalidates any partition table written with 512 byte LBAs, so this
+ * is strictly opt-in.
+ */
+static bool native_sector;
+module_param(native_sector, bool, 0644);
+MODULE_PARM_DESC(native_sector,
+		 "Switch eMMC with 4KiB native sectors out of 512B emulation");
 
 static const unsigned int tran_exp[] = {
 	10000,		100000,		1000000,	10000000,
@@ -606,6 +618,13 @@ static int mmc_decode_ext_csd(struct mmc_card *card, u8 *ext_csd)
 		else
 			card->ext_csd.data_sector_size = 512;
 
+		if (ext_csd[EXT_CSD_NATIVE_SECTOR_SIZE] == 1)
+			card->ext_csd.native_sector_size = 4096;
+		else
+			card->ext_csd.native_sector_size = 512;
+		card->ext_csd.raw_use_native_sector =
+			ext_csd[EXT_CSD_USE_NATIVE_SECTOR];
+
 		if ((ext_csd[EXT_CSD_DATA_TAG_SUPPORT] & 1) &&
 		    (ext_csd[EXT_CSD_TAG_UNIT_SIZE] <= 8)) {
 			card->ext_csd.data_tag_unit_size =
@@ -615,12 +634,17 @@ static int mmc_decode_ext_csd(struct mmc_card *card, u8 *ext_csd)
 			card->ext_csd.data_tag_unit_size = 0;
 		}
 
+		card->ext_csd.max_context_id =
+			ext_csd[EXT_CSD_CONTEXT_CAPABILITIES] &
+			EXT_CSD_MAX_CONTEXT_ID_MASK;
+
 		card->ext_csd.max_packed_writes =
 			ext_csd[EXT_CSD_MAX_PACKED_WRITES];
 		card->ext_csd.max_packed_reads =
 			ext_csd[EXT_CSD_MAX_PACKED_READS];
 	} else {
 		card->ext_csd.data_sector_size = 512;
+		card->ext_csd.native_sector_size = 512;
 	}
 
 	/*
@@ -1589,6 +1613,54 @@ static int mmc_hs200_tuning(struct mmc_card *card)
 	return mmc_execute_tuning(card);
 }
 
+/*
+ * Open the read/write contexts mmcblk steers writes into via the context ID
+ * in CMD23. Contexts are closed by a power cycle, but survive sleep, so on
+ * reinitialisation contexts that are still open are left alone and an open
+ * that fails is retried after closing the context.
+ */
+static void mmc_open_contexts(struct mmc_card *card, bool reinit)
+{
+	unsigned int nr = min_t(unsigned int, card->ext_csd.max_context_id,
+				MMC_NR_CONTEXTS);
+	unsigned int timeout_ms = card->ext_csd.generic_cmd6_time;
+	u8 *ext_csd = NULL;
+	unsigned int id;
+	int err = 0;
+
+	if (reinit && mmc_get_ext_csd(card, &ext_csd))
+		ext_csd = NULL;
+
+	for (id = 1; id <= nr; id++) {
+		if (ext_csd && ext_csd[EXT_CSD_CONTEXT_CONF + id - 1] ==
+			       EXT_CSD_CONTEXT_RW)
+			continue;
+
+		err = mmc_switch(card, EXT_CSD_CMD_SET_NORMAL,
+				 EXT_CSD_CONTEXT_CONF + id - 1,
+				 EXT_CSD_CONTEXT_RW, timeout_ms);
+		if (err) {
+			err = mmc_switch(card, EXT_CSD_CMD_SET_NORMAL,
+					 EXT_CSD_CONTEXT_CONF + id - 1,
+					 EXT_CSD_CONTEXT_CLOSED, timeout_ms);
+			if (!err)
+				err = mmc_switch(card, EXT_CSD_CMD_SET_NORMAL,
+						 EXT_CSD_CONTEXT_CONF + id - 1,
+						 EXT_CSD_CONTEXT_RW, timeout_ms);
+		}
+		if (err)
+			break;
+	}
+
+	kfree(ext_csd);
+
+	if (err)
+		pr_warn("%s: failed to open context %u (%d)\n",
+			mmc_hostname(card->host), id, err);
+
+	card->ext_csd.nr_contexts = id - 1;
+}
+
 /*
  * Handle the detection and initialisation of a card.
  *
@@ -1719,6 +1791,28 @@ static int mmc_init_card(struct mmc_host *host, u32 ocr,
 		if (err)
 			goto free_card;
 
+		/*
+		 * USE_NATIVE_SECTOR only takes effect after a power cycle,
+		 * have the caller redo the initialisation. Don't ask again if
+		 * the card already has it set but still emulates 512 bytes.
+		 */
+		if (native_sector && card->ext_csd.native_sector_size == 4096 &&
+		    card->ext_csd.data_sector_size == 512 &&
+		    !card->ext_csd.raw_use_native_sector) {
+			err = mmc_switch(card, EXT_CSD_CMD_SET_NORMAL,
+					 EXT_CSD_USE_NATIVE_SECTOR, 1,
+					 card->ext_csd.generic_cmd6_time);
+			if (!err) {
+				pr_info("%s: switched to native 4KiB sectors\n",
+					mmc_hostname(host));
+				err = -EAGAIN;
+				goto free_card;
+			}
+			pr_warn("%s: failed to switch to native sectors (%d)\n",
+				mmc_hostname(host), err);
+			err = 0;
+		}
+
 		/*
 		 * If doing byte addressing, check if required to do sector
 		 * addressing.  Handle the case of <2GB cards needing sector
@@ -1879,6 +1973,11 @@ static int mmc_init_card(struct mmc_host *host, u32 ocr,
 		}
 	}
 
+	/* Context IDs are only carried by CMD23, see mmc_blk_rw_rq_prep() */
+	card->ext_csd.nr_contexts = 0;
+	if (card->ext_csd.max_context_id && mmc_host_cmd23(host))
+		mmc_open_contexts(card, !!oldcard);
+
 	/*
 	 * Enable Command Queue if supported. Note that Packed Commands cannot
 	 * be used with Command Queue.
@@ -2318,9 +2417,14 @@ int mmc_attach_mmc(struct mmc_host *host)
 	}
 
 	/*
-	 * Detect and init the card.
+	 * Detect and init the card. -EAGAIN means the card changed its sector
+	 * size, which needs a power cycle to take effect.
 	 */
 	err = mmc_init_card(host, rocr, NULL);
+	if (err == -EAGAIN) {
+		mmc_power_cycle(host, rocr);
+		err = mmc_init_card(host, rocr, NULL);
+	}
 	if (err)
 		goto err;
 
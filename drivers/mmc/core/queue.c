@@ -40,15 +40,41 @@ static inline bool mmc_cqe_can_dcmd(struct mmc_host *host)
 	return host->caps2 & MMC_CAP2_CQE_DCMD;
 }
 
+/*
+ * Discards can be issued as direct commands when the card accepts a sector
+ * granular erase argument, so no erase group alignment is needed.
+ */
+static bool mmc_cqe_can_dcmd_discard(struct mmc_host *host)
+{
+	struct mmc_card *card = host->card;
+
+	if (!mmc_cqe_can_dcmd(host) || !card || !mmc_card_mmc(card))
+		return false;
+
+	if (!mmc_can_erase(card) || card->quirks & MMC_QUIRK_INAND_CMD38)
+		return false;
+
+	/* Without busy polling, one erase group has to fit the busy timeout */
+	if (host->max_busy_timeout &&
+	    mmc_erase_busy_timeout(card, card->erase_arg, 0, 1) >
+	    host->max_busy_timeout)
+		return false;
+
+	return card->erase_arg == MMC_DISCARD_ARG ||
+	       card->erase_arg == MMC_TRIM_ARG;
+}
+
 static enum mmc_issue_type mmc_cqe_issue_type(struct mmc_host *host,
 					      struct request *req)
 {
 	switch (req_op(req)) {
 	case REQ_OP_DRV_IN:
 	case REQ_OP_DRV_OUT:
-	case REQ_OP_DISCARD:
 	case REQ_OP_SECURE_ERASE:
 		return MMC_ISSUE_SYNC;
+	case REQ_OP_DISCARD:
+		return mmc_cqe_can_dcmd_discard(host) ? MMC_ISSUE_DCMD :
+							MMC_ISSUE_SYNC;
 	case REQ_OP_FLUSH:
 		return mmc_cqe_can_dcmd(host) ? MMC_ISSUE_DCMD : MMC_ISSUE_SYNC;
 	default:
@@ -328,6 +354,7 @@ static blk_status_t mmc_mq_queue_rq(struct blk_mq_hw_ctx *hctx,
 		mq->in_flight[issue_type] -= 1;
 		if (mmc_tot_in_flight(mq) == 0)
 			put_card = true;
+		mmc_cqe_check_busy(mq);
 		mq->busy = false;
 		spin_unlock_irq(&mq->lock);
 		if (put_card)
@@ -373,6 +400,15 @@ static void mmc_setup_queue(struct mmc_queue *mq, struct mmc_card *card)
 	}
 
 	blk_queue_logical_block_size(mq->queue, block_size);
+	/*
+	 * In 512 byte emulation a large sector device still does a
+	 * read-modify-write for anything smaller, so let the upper layers
+	 * align to the native sector.
+	 */
+	if (mmc_card_mmc(card) &&
+	    card->ext_csd.native_sector_size > block_size)
+		blk_queue_physical_block_size(mq->queue,
+					      card->ext_csd.native_sector_size);
 	/*
 	 * After blk_queue_can_use_dma_map_merging() was called with succeed,
 	 * since it calls blk_queue_virt_boundary(), the mmc should not call
@@ -37,6 +37,7 @@
 #include <linux/interrupt.h>
 #include <linux/io.h>
 #include <linux/iopoll.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/of_address.h>
 #include <linux/of_irq.h>
@@ -140,6 +141,12 @@
 #define SDDATA_FIFO_PIO_BURST	8
 
 #define PIO_THRESHOLD	1  /* Maximum block count for PIO (0 = always DMA) */
+#define PIO_CALIBRATE_LOOPS	16
+
+static int pio_limit = PIO_THRESHOLD;
+module_param(pio_limit, int, 0644);
+MODULE_PARM_DESC(pio_limit,
+		 "Default maximum block count for PIO (0 = always DMA, -1 = calibrate)");
 
 struct bcm2835_host {
 	spinlock_t		lock;
@@ -187,6 +194,11 @@ struct bcm2835_host {
 	struct page		*drain_page;
 	u32			drain_offset;
 	bool			use_dma;
+
+	/* DMA/PIO crossover */
+	int			pio_limit;	/* Maximum block count for PIO */
+	bool			pio_limit_auto;	/* Derive pio_limit from clock */
+	u32			dma_setup_ns;	/* Measured DMA setup cost */
 };
 
 static void bcm2835_dumpcmd(struct bcm2835_host *host, struct mmc_command *cmd,
@@ -1097,6 +1109,26 @@ static void bcm2835_dma_complete_work(struct work_struct *work)
 	mutex_unlock(&host->mutex);
 }
 
+/*
+ * Use PIO for as many blocks as can be moved through the FIFO in the time
+ * it takes to set up a DMA transfer.  PIO spins on the FIFO, so its cost is
+ * set by the card clock and bus width, and needs redoing when they change.
+ */
+static void bcm2835_update_pio_limit(struct bcm2835_host *host)
+{
+	struct mmc_host *mmc = mmc_from_priv(host);
+	u32 ns_per_block;
+
+	if (!host->pio_limit_auto || !host->dma_setup_ns ||
+	    !mmc->actual_clock)
+		return;
+
+	ns_per_block = (1000000000 / mmc->actual_clock) *
+		((mmc->ios.bus_width == MMC_BUS_WIDTH_4) ? 8 : 32) * (512 / 4);
+
+	WRITE_ONCE(host->pio_limit, host->dma_setup_ns / ns_per_block);
+}
+
 static void bcm2835_set_clock(struct bcm2835_host *host, unsigned int clock)
 {
 	struct mmc_host *mmc = mmc_from_priv(host);
@@ -1207,7 +1239,8 @@ static void bcm2835_request(struct mmc_host *mmc, struct mmc_request *mrq)
 		return;
 	}
 
-	if (host->use_dma && mrq->data && (mrq->data->blocks > PIO_THRESHOLD))
+	if (host->use_dma && mrq->data &&
+	    (mrq->data->blocks > READ_ONCE(host->pio_limit)))
 		bcm2835_prepare_dma(host, mrq->data);
 
 	host->use_sbc = !!mrq->sbc && host->mrq->data &&
@@ -1253,6 +1286,8 @@ static void bcm2835_set_ios(struct mmc_host *mmc, struct mmc_ios *ios)
 
 	writel(host->hcfg, host->ioaddr + SDHCFG);
 
+	bcm2835_update_pio_limit(host);
+
 	mutex_unlock(&host->mutex);
 }
 
@@ -1262,11 +1297,98 @@ static const struct mmc_host_ops bcm2835_ops = {
 	.card_hw_reset = bcm2835_reset,
 };
 
+/*
+ * Time mapping and preparing a single block read, which is what a request
+ * pays for going the DMA route.  The descriptors are never submitted;
+ * terminating the channel frees them again.
+ */
+static void bcm2835_calibrate_dma(struct bcm2835_host *host)
+{
+	struct dma_chan *dma_chan = host->dma_chan_rxtx;
+	struct device *dma_dev = dma_chan->device->dev;
+	struct dma_async_tx_descriptor *desc;
+	struct scatterlist sg;
+	struct page *page;
+	ktime_t start;
+	s64 ns = 0;
+	int i;
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return;
+
+	sg_init_table(&sg, 1);
+	sg_set_page(&sg, page, 512, 0);
+
+	for (i = 0; i < PIO_CALIBRATE_LOOPS; i++) {
+		start = ktime_get();
+		if (!dma_map_sg(dma_dev, &sg, 1, DMA_FROM_DEVICE))
+			break;
+		desc = dmaengine_prep_slave_sg(dma_chan, &sg, 1,
+					       DMA_DEV_TO_MEM,
+					       DMA_PREP_INTERRUPT |
+					       DMA_CTRL_ACK);
+		ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		dmaengine_terminate_sync(dma_chan);
+		dma_unmap_sg(dma_dev, &sg, 1, DMA_FROM_DEVICE);
+		if (!desc)
+			break;
+	}
+
+	__free_page(page);
+
+	if (i == PIO_CALIBRATE_LOOPS)
+		host->dma_setup_ns = div_s64(ns, PIO_CALIBRATE_LOOPS);
+}
+
+static ssize_t pio_limit_show(struct device *dev,
+			      struct device_attribute *attr, char *buf)
+{
+	struct bcm2835_host *host = dev_get_drvdata(dev);
+
+	return sysfs_emit(buf, "%d%s\n", READ_ONCE(host->pio_limit),
+			  host->pio_limit_auto ? " (auto)" : "");
+}
+
+static ssize_t pio_limit_store(struct device *dev,
+			       struct device_attribute *attr,
+			       const char *buf, size_t count)
+{
+	struct bcm2835_host *host = dev_get_drvdata(dev);
+	int val, ret;
+
+	ret = kstrtoint(buf, 0, &val);
+	if (ret)
+		return ret;
+
+	/* Auto mode needs the DMA setup time measured at probe */
+	if (val < 0 && !host->dma_setup_ns)
+		return -EINVAL;
+
+	mutex_lock(&host->mutex);
+	host->pio_limit_auto = val < 0;
+	if (host->pio_limit_auto)
+		bcm2835_update_pio_limit(host);
+	else
+		WRITE_ONCE(host->pio_limit, val);
+	mutex_unlock(&host->mutex);
+
+	return count;
+}
+static DEVICE_ATTR_RW(pio_limit);
+
+static struct attribute *bcm2835_attrs[] = {
+	&dev_attr_pio_limit.attr,
+	NULL
+};
+ATTRIBUTE_GROUPS(bcm2835);
+
 static int bcm2835_add_host(struct bcm2835_host *host)
 {
 	struct mmc_host *mmc = mmc_from_priv(host);
 	struct device *dev = &host->pdev->dev;
-	char pio_limit_string[20];
+	char pio_limit_string[32];
 	int ret;
 
 	if (!mmc->f_max || mmc->f_max > host->max_clk)
@@ -1310,6 +1432,14 @@ static int bcm2835_add_host(struct bcm2835_host *host)
 			host->use_dma = false;
 	}
 
+	host->pio_limit = PIO_THRESHOLD;
+	if (pio_limit >= 0)
+		host->pio_limit = pio_limit;
+	/* Also calibrate for a later switch to auto mode through sysfs */
+	if (host->use_dma)
+		bcm2835_calibrate_dma(host);
+	host->pio_limit_auto = pio_limit < 0 && host->dma_setup_ns;
+
 	mmc->max_segs = 128;
 	mmc->max_req_size = min_t(size_t, 524288, dma_max_mapping_size(dev));
 	mmc->max_seg_size = mmc->max_req_size;
@@ -1342,8 +1472,10 @@ static int bcm2835_add_host(struct bcm2835_host *host)
 	}
 
 	pio_limit_string[0] = '\0';
-	if (host->use_dma && (PIO_THRESHOLD > 0))
-		sprintf(pio_limit_string, " (>%d)", PIO_THRESHOLD);
+	if (host->use_dma && host->pio_limit_auto)
+		sprintf(pio_limit_string, " (setup %uns)", host->dma_setup_ns);
+	else if (host->use_dma && (host->pio_limit > 0))
+		sprintf(pio_limit_string, " (>%d)", host->pio_limit);
 	dev_info(dev, "loaded - DMA %s%s\n",
 		 host->use_dma ? "enabled" : "disabled", pio_limit_string);
 
@@ -1474,6 +1606,7 @@ static struct platform_driver bcm2835_driver = {
 		.name		= "sdhost-bcm2835",
 		.probe_type	= PROBE_PREFER_ASYNCHRONOUS,
 		.of_match_table	= bcm2835_match,
+		.dev_groups	= bcm2835_groups,
 	},
 };
 module_platform_driver(bcm2835_driver);
@@ -2,6 +2,8 @@
 /* Copyright (c) 2015, The Linux Foundation. All rights reserved.
  */
 
+#include <linux/bitmap.h>
+#include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/highmem.h>
 #include <linux/io.h>
@@ -23,8 +25,19 @@
 #define DCMD_SLOT 31
 #define NUM_SLOTS 32
 
+/*
+ * Transfer descriptors are handed out per request from a shared pool in
+ * units of CQHCI_TDL_UNIT_SEGS descriptors. The pool is sized for an average
+ * of CQHCI_TDL_AVG_SEGS segments per queued request, but always holds at
+ * least one request with the maximum number of segments.
+ */
+#define CQHCI_TDL_UNIT_SEGS	16
+#define CQHCI_TDL_AVG_SEGS	32
+
 struct cqhci_slot {
 	struct mmc_request *mrq;
+	unsigned int tdl_unit;
+	unsigned int tdl_nr;
 	unsigned int flags;
 #define CQHCI_EXTERNAL_TIMEOUT	BIT(0)
 #define CQHCI_COMPLETED		BIT(1)
@@ -45,32 +58,48 @@ static inline u8 *get_link_desc(struct cqhci_host *cq_host, u8 tag)
 	return desc + cq_host->task_desc_len;
 }
 
-static inline size_t get_trans_desc_offset(struct cqhci_host *cq_host, u8 tag)
+static inline size_t get_trans_desc_offset(struct cqhci_host *cq_host,
+					   unsigned int unit)
 {
-	return cq_host->trans_desc_len * cq_host->mmc->max_segs * tag;
+	return cq_host->trans_desc_len * CQHCI_TDL_UNIT_SEGS * unit;
 }
 
-static inline dma_addr_t get_trans_desc_dma(struct cqhci_host *cq_host, u8 tag)
+static inline dma_addr_t get_trans_desc_dma(struct cqhci_host *cq_host,
+					    unsigned int unit)
 {
-	size_t offset = get_trans_desc_offset(cq_host, tag);
+	size_t offset = get_trans_desc_offset(cq_host, unit);
 
 	return cq_host->trans_desc_dma_base + offset;
 }
 
-static inline u8 *get_trans_desc(struct cqhci_host *cq_host, u8 tag)
+static inline u8 *get_trans_desc(struct cqhci_host *cq_host, unsigned int unit)
 {
-	size_t offset = get_trans_desc_offset(cq_host, tag);
+	size_t offset = get_trans_desc_offset(cq_host, unit);
 
 	return cq_host->trans_desc_base + offset;
 }
 
+static void cqhci_set_link_addr(struct cqhci_host *cq_host, u8 tag,
+				dma_addr_t addr)
+{
+	u8 *link_temp = get_link_desc(cq_host, tag);
+
+	if (cq_host->dma64) {
+		__le64 *data_addr = (__le64 __force *)(link_temp + 4);
+
+		data_addr[0] = cpu_to_le64(addr);
+	} else {
+		__le32 *data_addr = (__le32 __force *)(link_temp + 4);
+
+		data_addr[0] = cpu_to_le32(addr);
+	}
+}
+
 static void setup_trans_desc(struct cqhci_host *cq_host, u8 tag)
 {
 	u8 *link_temp;
-	dma_addr_t trans_temp;
 
 	link_temp = get_link_desc(cq_host, tag);
-	trans_temp = get_trans_desc_dma(cq_host, tag);
 
 	memset(link_temp, 0, cq_host->link_desc_len);
 	if (cq_host->link_desc_len > 8)
@@ -83,15 +112,19 @@ static void setup_trans_desc(struct cqhci_host *cq_host, u8 tag)
 
 	*link_temp = CQHCI_VALID(1) | CQHCI_ACT(0x6) | CQHCI_END(0);
 
-	if (cq_host->dma64) {
-		__le64 *data_addr = (__le64 __force *)(link_temp + 4);
+	/* The address is filled in per request, see cqhci_prep_tran_desc() */
+	cqhci_set_link_addr(cq_host, tag, get_trans_desc_dma(cq_host, 0));
+}
 
-		data_addr[0] = cpu_to_le64(trans_temp);
-	} else {
-		__le32 *data_addr = (__le32 __force *)(link_temp + 4);
+static unsigned int cqhci_tdl_units(struct cqhci_host *cq_host)
+{
+	unsigned int qdepth = cq_host->mmc->cqe_qdepth;
+	unsigned int unit_max = DIV_ROUND_UP(cq_host->mmc->max_segs,
+					     CQHCI_TDL_UNIT_SEGS);
+	unsigned int units = DIV_ROUND_UP(qdepth * CQHCI_TDL_AVG_SEGS,
+					  CQHCI_TDL_UNIT_SEGS);
 
-		data_addr[0] = cpu_to_le32(trans_temp);
-	}
+	return clamp(units, unit_max, qdepth * unit_max);
 }
 
 static void cqhci_set_irqs(struct cqhci_host *cq_host, u32 set)
@@ -160,11 +193,13 @@ static void cqhci_dumpregs(struct cqhci_host *cq_host)
  * |link desc-|->|  |----------|
  * |----------|          .
  *      .                .
- *  no. of slots      max-segs
+ *  no. of slots     tdl-units
  *      .           |----------|
  * |----------|
- * The idea here is to create the [task+trans] table and mark & point the
- * link desc to the transfer desc table on a per slot basis.
+ * The idea here is to create the [task+trans] table and mark the link desc
+ * of each slot. The transfer descriptors are a pool shared by all slots, and
+ * each link desc is pointed at the units allocated for its request when the
+ * request is issued.
  */
 static int cqhci_host_alloc_tdl(struct cqhci_host *cq_host)
 {
@@ -200,11 +235,16 @@ static int cqhci_host_alloc_tdl(struct cqhci_host *cq_host)
 
 	cq_host->desc_size = cq_host->slot_sz * cq_host->num_slots;
 
-	cq_host->data_size = get_trans_desc_offset(cq_host, cq_host->mmc->cqe_qdepth);
+	cq_host->tdl_units = cqhci_tdl_units(cq_host);
+	cq_host->data_size = get_trans_desc_offset(cq_host, cq_host->tdl_units);
 
-	pr_debug("%s: cqhci: desc_size: %zu data_sz: %zu slot-sz: %d\n",
+	pr_debug("%s: cqhci: desc_size: %zu data_sz: %zu slot-sz: %d tdl-units: %u\n",
 		 mmc_hostname(cq_host->mmc), cq_host->desc_size, cq_host->data_size,
-		 cq_host->slot_sz);
+		 cq_host->slot_sz, cq_host->tdl_units);
+
+	cq_host->tdl_map = bitmap_zalloc(cq_host->tdl_units, GFP_KERNEL);
+	if (!cq_host->tdl_map)
+		return -ENOMEM;
 
 	/*
 	 * allocate a dma-mapped chunk of memory for the descriptors
@@ -216,8 +256,11 @@ static int cqhci_host_alloc_tdl(struct cqhci_host *cq_host)
 						 cq_host->desc_size,
 						 &cq_host->desc_dma_base,
 						 GFP_KERNEL);
-	if (!cq_host->desc_base)
+	if (!cq_host->desc_base) {
+		bitmap_free(cq_host->tdl_map);
+		cq_host->tdl_map = NULL;
 		return -ENOMEM;
+	}
 
 	cq_host->trans_desc_base = dmam_alloc_coherent(mmc_dev(cq_host->mmc),
 					      cq_host->data_size,
@@ -229,6 +272,8 @@ static int cqhci_host_alloc_tdl(struct cqhci_host *cq_host)
 				   cq_host->desc_dma_base);
 		cq_host->desc_base = NULL;
 		cq_host->desc_dma_base = 0;
+		bitmap_free(cq_host->tdl_map);
+		cq_host->tdl_map = NULL;
 		return -ENOMEM;
 	}
 
@@ -243,6 +288,54 @@ static int cqhci_host_alloc_tdl(struct cqhci_host *cq_host)
 	return 0;
 }
 
+/*
+ * Queue depth at which adaptive interrupt coalescing is switched on. It is
+ * switched off again once the queue is empty, so QD1 I/O never waits for the
+ * coalescing timer.
+ */
+#define CQHCI_IC_ADAPTIVE_QD	4
+
+/* Must be called with cq_host->lock held */
+static void cqhci_ic_update(struct cqhci_host *cq_host)
+{
+	bool on;
+	u32 ic = 0;
+
+	switch (cq_host->ic_mode) {
+	case CQHCI_IC_ON:
+		on = true;
+		break;
+	case CQHCI_IC_ADAPTIVE:
+		if (cq_host->qcnt >= CQHCI_IC_ADAPTIVE_QD)
+			on = true;
+		else if (!cq_host->qcnt)
+			on = false;
+		else
+			return;
+		break;
+	default:
+		on = false;
+		break;
+	}
+
+	/* Tasks already counted by the coalescing logic must still interrupt */
+	if (!on && cq_host->qcnt)
+		return;
+
+	/* A zero timeout would leave a partial batch waiting forever */
+	if (on)
+		ic = CQHCI_IC_ENABLE |
+		     CQHCI_IC_ICCTHWEN | CQHCI_IC_ICCTH(cq_host->ic_count) |
+		     CQHCI_IC_ICTOVALWEN |
+		     CQHCI_IC_ICTOVAL(cq_host->ic_timeout ?: CQHCI_IC_DEFAULT_ICTOVAL);
+
+	if (ic == cq_host->ic_reg)
+		return;
+
+	cqhci_writel(cq_host, ic, CQHCI_IC);
+	cq_host->ic_reg = ic;
+}
+
 static void __cqhci_enable(struct cqhci_host *cq_host)
 {
 	struct mmc_host *mmc = cq_host->mmc;
@@ -276,6 +369,9 @@ static void __cqhci_enable(struct cqhci_host *cq_host)
 
 	cqhci_writel(cq_host, cq_host->rca, CQHCI_SSC2);
 
+	cqhci_writel(cq_host, 0, CQHCI_IC);
+	cq_host->ic_reg = 0;
+
 	cqhci_set_irqs(cq_host, 0);
 
 	cqcfg |= CQHCI_ENABLE;
@@ -329,6 +425,105 @@ int cqhci_resume(struct mmc_host *mmc)
 }
 EXPORT_SYMBOL(cqhci_resume);
 
+static int cqhci_ic_mode_get(void *data, u64 *val)
+{
+	struct cqhci_host *cq_host = data;
+
+	*val = READ_ONCE(cq_host->ic_mode);
+
+	return 0;
+}
+
+static int cqhci_ic_mode_set(void *data, u64 val)
+{
+	struct cqhci_host *cq_host = data;
+
+	if (val > CQHCI_IC_ADAPTIVE)
+		return -EINVAL;
+
+	WRITE_ONCE(cq_host->ic_mode, val);
+
+	return 0;
+}
+
+DEFINE_DEBUGFS_ATTRIBUTE(cqhci_ic_mode_fops, cqhci_ic_mode_get,
+			 cqhci_ic_mode_set, "%llu\n");
+
+static int cqhci_ic_count_get(void *data, u64 *val)
+{
+	struct cqhci_host *cq_host = data;
+
+	*val = READ_ONCE(cq_host->ic_count);
+
+	return 0;
+}
+
+/* A threshold of 0 would never coalesce */
+static int cqhci_ic_count_set(void *data, u64 val)
+{
+	struct cqhci_host *cq_host = data;
+
+	if (!val || val > CQHCI_IC_MAX_ICCTH)
+		return -EINVAL;
+
+	WRITE_ONCE(cq_host->ic_count, val);
+
+	return 0;
+}
+
+DEFINE_DEBUGFS_ATTRIBUTE(cqhci_ic_count_fops, cqhci_ic_count_get,
+			 cqhci_ic_count_set, "%llu\n");
+
+static int cqhci_ic_timeout_get(void *data, u64 *val)
+{
+	struct cqhci_host *cq_host = data;
+
+	*val = READ_ONCE(cq_host->ic_timeout);
+
+	return 0;
+}
+
+/* 0 selects CQHCI_IC_DEFAULT_ICTOVAL */
+static int cqhci_ic_timeout_set(void *data, u64 val)
+{
+	struct cqhci_host *cq_host = data;
+
+	if (val > CQHCI_IC_MAX_ICTOVAL)
+		return -EINVAL;
+
+	WRITE_ONCE(cq_host->ic_timeout, val);
+
+	return 0;
+}
+
+DEFINE_DEBUGFS_ATTRIBUTE(cqhci_ic_timeout_fops, cqhci_ic_timeout_get,
+			 cqhci_ic_timeout_set, "%llu\n");
+
+/*
+ * Interrupt coalescing is tuned through debugfs. Changes take effect the next
+ * time a task is issued, or when the queue next empties if coalescing is being
+ * turned off. tcc_irqs / tcc_tasks gives the completion interrupts per I/O.
+ */
+static void cqhci_debugfs_init(struct cqhci_host *cq_host)
+{
+	struct mmc_host *mmc = cq_host->mmc;
+	struct dentry *root;
+
+	if (cq_host->debugfs || !mmc->debugfs_root)
+		return;
+
+	root = debugfs_create_dir("cqhci", mmc->debugfs_root);
+	debugfs_create_file_unsafe("ic_mode", 0600, root, cq_host,
+				   &cqhci_ic_mode_fops);
+	debugfs_create_file_unsafe("ic_count", 0600, root, cq_host,
+				   &cqhci_ic_count_fops);
+	debugfs_create_file_unsafe("ic_timeout", 0600, root, cq_host,
+				   &cqhci_ic_timeout_fops);
+	debugfs_create_u64("tcc_irqs", 0400, root, &cq_host->tcc_irqs);
+	debugfs_create_u64("tcc_tasks", 0400, root, &cq_host->tcc_tasks);
+	cq_host->debugfs = root;
+}
+
 static int cqhci_enable(struct mmc_host *mmc, struct mmc_card *card)
 {
 	struct cqhci_host *cq_host = mmc->cqe_private;
@@ -353,6 +548,10 @@ static int cqhci_enable(struct mmc_host *mmc, struct mmc_card *card)
 
 	cq_host->enabled = true;
 
+	/* The host debugfs directory only exists once the host is added */
+	cqhci_debugfs_init(cq_host);
+	cqhci_crypto_debugfs_init(cq_host);
+
 #ifdef DEBUG
 	cqhci_dumpregs(cq_host);
 #endif
@@ -416,6 +615,9 @@ static void cqhci_disable(struct mmc_host *mmc)
 	cq_host->trans_desc_base = NULL;
 	cq_host->desc_base = NULL;
 
+	bitmap_free(cq_host->tdl_map);
+	cq_host->tdl_map = NULL;
+
 	cq_host->enabled = false;
 }
 
@@ -442,7 +644,7 @@ static void cqhci_prep_task_desc(struct mmc_request *mrq,
 	task_desc[0] = cpu_to_le64(desc0);
 
 	if (cq_host->caps & CQHCI_TASK_DESC_SZ_128) {
-		u64 desc1 = cqhci_crypto_prep_task_desc(mrq);
+		u64 desc1 = cqhci_crypto_prep_task_desc(cq_host, mrq);
 
 		task_desc[1] = cpu_to_le64(desc1);
 
@@ -496,6 +698,17 @@ static void cqhci_set_tran_desc(u8 *desc, dma_addr_t addr, int len, bool end,
 	}
 }
 
+static void cqhci_post_req(struct mmc_host *host, struct mmc_request *mrq)
+{
+	struct mmc_data *data = mrq->data;
+
+	if (data) {
+		dma_unmap_sg(mmc_dev(host), data->sg, data->sg_len,
+			     (data->flags & MMC_DATA_READ) ?
+			     DMA_FROM_DEVICE : DMA_TO_DEVICE);
+	}
+}
+
 static int cqhci_prep_tran_desc(struct mmc_request *mrq,
 			       struct cqhci_host *cq_host, int tag)
 {
@@ -506,6 +719,9 @@ static int cqhci_prep_tran_desc(struct mmc_request *mrq,
 	dma_addr_t addr;
 	u8 *desc;
 	struct scatterlist *sg;
+	struct cqhci_slot *slot = &cq_host->slot[tag];
+	unsigned long flags;
+	unsigned int nr, unit;
 
 	sg_count = cqhci_dma_map(mrq->host, mrq);
 	if (sg_count < 0) {
@@ -514,7 +730,28 @@ static int cqhci_prep_tran_desc(struct mmc_request *mrq,
 		return sg_count;
 	}
 
-	desc = get_trans_desc(cq_host, tag);
+	nr = DIV_ROUND_UP(sg_count, CQHCI_TDL_UNIT_SEGS);
+
+	spin_lock_irqsave(&cq_host->lock, flags);
+	unit = bitmap_find_next_zero_area(cq_host->tdl_map, cq_host->tdl_units,
+					  0, nr, 0);
+	if (unit < cq_host->tdl_units)
+		bitmap_set(cq_host->tdl_map, unit, nr);
+	spin_unlock_irqrestore(&cq_host->lock, flags);
+
+	/*
+	 * The pool always fits one maximum sized request, so running out only
+	 * means other requests are in flight. Let the block layer retry.
+	 */
+	if (unit >= cq_host->tdl_units) {
+		cqhci_post_req(mrq->host, mrq);
+		return -EBUSY;
+	}
+
+	slot->tdl_unit = unit;
+	slot->tdl_nr = nr;
+
+	desc = get_trans_desc(cq_host, unit);
 
 	for_each_sg(data->sg, sg, sg_count, i) {
 		addr = sg_dma_address(sg);
@@ -526,9 +763,23 @@ static int cqhci_prep_tran_desc(struct mmc_request *mrq,
 		desc += cq_host->trans_desc_len;
 	}
 
+	cqhci_set_link_addr(cq_host, tag, get_trans_desc_dma(cq_host, unit));
+
 	return 0;
 }
 
+/* Must be called with cq_host->lock held */
+static void cqhci_free_tran_desc(struct cqhci_host *cq_host, int tag)
+{
+	struct cqhci_slot *slot = &cq_host->slot[tag];
+
+	if (!slot->tdl_nr)
+		return;
+
+	bitmap_clear(cq_host->tdl_map, slot->tdl_unit, slot->tdl_nr);
+	slot->tdl_nr = 0;
+}
+
 static void cqhci_prep_dcmd_desc(struct mmc_host *mmc,
 				   struct mmc_request *mrq)
 {
@@ -573,20 +824,27 @@ static void cqhci_prep_dcmd_desc(struct mmc_host *mmc,
 
 }
 
-static void cqhci_post_req(struct mmc_host *host, struct mmc_request *mrq)
+static inline int cqhci_tag(struct mmc_request *mrq)
 {
-	struct mmc_data *data = mrq->data;
-
-	if (data) {
-		dma_unmap_sg(mmc_dev(host), data->sg, data->sg_len,
-			     (data->flags & MMC_DATA_READ) ?
-			     DMA_FROM_DEVICE : DMA_TO_DEVICE);
-	}
+	return mrq->cmd ? DCMD_SLOT : mrq->tag;
 }
 
-static inline int cqhci_tag(struct mmc_request *mrq)
+/*
+ * Coalesced tasks must not interrupt on their own. Must be called with
+ * cq_host->lock held after cqhci_ic_update(), so that the INT bit matches the
+ * coalescing state the task is submitted under.
+ */
+static void cqhci_set_task_int(struct cqhci_host *cq_host, int tag)
 {
-	return mrq->cmd ? DCMD_SLOT : mrq->tag;
+	__le64 *task_desc = (__le64 __force *)get_desc(cq_host, tag);
+	u64 desc0 = le64_to_cpu(task_desc[0]);
+
+	if (cq_host->ic_reg & CQHCI_IC_ENABLE)
+		desc0 &= ~CQHCI_INT(1);
+	else
+		desc0 |= CQHCI_INT(1);
+
+	task_desc[0] = cpu_to_le64(desc0);
 }
 
 static int cqhci_request(struct mmc_host *mmc, struct mmc_request *mrq)
@@ -624,6 +882,8 @@ static int cqhci_request(struct mmc_host *mmc, struct mmc_request *mrq)
 		cqhci_prep_task_desc(mrq, cq_host, tag);
 
 		err = cqhci_prep_tran_desc(mrq, cq_host, tag);
+		if (err == -EBUSY)
+			return err;
 		if (err) {
 			pr_err("%s: cqhci: failed to setup tx desc: %d\n",
 			       mmc_hostname(mmc), err);
@@ -636,6 +896,7 @@ static int cqhci_request(struct mmc_host *mmc, struct mmc_request *mrq)
 	spin_lock_irqsave(&cq_host->lock, flags);
 
 	if (cq_host->recovery_halt) {
+		cqhci_free_tran_desc(cq_host, tag);
 		err = -EBUSY;
 		goto out_unlock;
 	}
@@ -644,6 +905,9 @@ static int cqhci_request(struct mmc_host *mmc, struct mmc_request *mrq)
 	cq_host->slot[tag].flags = 0;
 
 	cq_host->qcnt += 1;
+	cqhci_ic_update(cq_host);
+	if (mrq->data)
+		cqhci_set_task_int(cq_host, tag);
 	/* Make sure descriptors are ready before ringing the doorbell */
 	wmb();
 	cqhci_writel(cq_host, 1 << tag, CQHCI_TDBR);
@@ -795,6 +1059,7 @@ static void cqhci_finish_mrq(struct mmc_host *mmc, unsigned int tag)
 	}
 
 	slot->mrq = NULL;
+	cqhci_free_tran_desc(cq_host, tag);
 
 	cq_host->qcnt -= 1;
 
@@ -841,6 +1106,9 @@ irqreturn_t cqhci_irq(struct mmc_host *mmc, u32 intmask, int cmd_error,
 
 		spin_lock(&cq_host->lock);
 
+		cq_host->tcc_irqs += 1;
+		cq_host->tcc_tasks += hweight_long(comp_status);
+
 		for_each_set_bit(tag, &comp_status, cq_host->num_slots) {
 			/* complete the corresponding mrq */
 			pr_debug("%s: cqhci: completing tag %lu\n",
@@ -848,6 +1116,9 @@ irqreturn_t cqhci_irq(struct mmc_host *mmc, u32 intmask, int cmd_error,
 			cqhci_finish_mrq(mmc, tag);
 		}
 
+		if (!cq_host->qcnt)
+			cqhci_ic_update(cq_host);
+
 		if (cq_host->waiting_for_idle && !cq_host->qcnt) {
 			cq_host->waiting_for_idle = false;
 			wake_up(&cq_host->wait_queue);
@@ -1025,12 +1296,17 @@ static void cqhci_recover_mrq(struct cqhci_host *cq_host, unsigned int tag)
 	struct cqhci_slot *slot = &cq_host->slot[tag];
 	struct mmc_request *mrq = slot->mrq;
 	struct mmc_data *data;
+	unsigned long flags;
 
 	if (!mrq)
 		return;
 
 	slot->mrq = NULL;
 
+	spin_lock_irqsave(&cq_host->lock, flags);
+	cqhci_free_tran_desc(cq_host, tag);
+	spin_unlock_irqrestore(&cq_host->lock, flags);
+
 	cq_host->qcnt -= 1;
 
 	data = mrq->data;
@@ -1106,6 +1382,9 @@ static void cqhci_recovery_finish(struct mmc_host *mmc)
 	cq_host->qcnt = 0;
 	cq_host->recovery_halt = false;
 	mmc->cqe_on = false;
+	/* The controller may have been reset, so reprogram coalescing */
+	cqhci_writel(cq_host, 0, CQHCI_IC);
+	cq_host->ic_reg = 0;
 	spin_unlock_irqrestore(&cq_host->lock, flags);
 
 	/* Ensure all writes are done before interrupts are re-enabled */
@@ -1183,6 +1462,10 @@ int cqhci_init(struct cqhci_host *cq_host, struct mmc_host *mmc,
 	cq_host->num_slots = NUM_SLOTS;
 	cq_host->dcmd_slot = DCMD_SLOT;
 
+	cq_host->ic_mode = CQHCI_IC_OFF;
+	cq_host->ic_count = CQHCI_IC_DEFAULT_ICCTH;
+	cq_host->ic_timeout = CQHCI_IC_DEFAULT_ICTOVAL;
+
 	mmc->cqe_ops = &cqhci_cqe_ops;
 
 	mmc->cqe_qdepth = NUM_SLOTS;
@@ -7,6 +7,7 @@
 
 #include <linux/blk-crypto.h>
 #include <linux/blk-crypto-profile.h>
+#include <linux/debugfs.h>
 #include <linux/mmc/host.h>
 
 #include "cqhci-crypto.h"
@@ -102,6 +103,11 @@ static int cqhci_crypto_keyslot_program(struct blk_crypto_profile *profile,
 	err = cqhci_crypto_program_key(cq_host, &cfg, slot);
 
 	memzero_explicit(&cfg, sizeof(cfg));
+
+	if (!err) {
+		set_bit(slot, cq_host->crypto_slot_fresh);
+		cq_host->crypto_slot_programs++;
+	}
 	return err;
 }
 
@@ -122,6 +128,9 @@ static int cqhci_crypto_keyslot_evict(struct blk_crypto_profile *profile,
 {
 	struct cqhci_host *cq_host = cqhci_host_from_crypto_profile(profile);
 
+	clear_bit(slot, cq_host->crypto_slot_fresh);
+	cq_host->crypto_slot_evicts++;
+
 	return cqhci_crypto_clear_keyslot(cq_host, slot);
 }
 
@@ -200,6 +209,13 @@ int cqhci_crypto_init(struct cqhci_host *cq_host)
 	 */
 	num_keyslots = cq_host->crypto_capabilities.config_count + 1;
 
+	cq_host->crypto_slot_fresh = devm_bitmap_zalloc(dev, num_keyslots,
+							GFP_KERNEL);
+	if (!cq_host->crypto_slot_fresh) {
+		err = -ENOMEM;
+		goto out;
+	}
+
 	err = devm_blk_crypto_profile_init(dev, profile, num_keyslots);
 	if (err)
 		goto out;
@@ -241,3 +257,33 @@ out:
 	mmc->caps2 &= ~MMC_CAP2_CRYPTO;
 	return err;
 }
+
+/**
+ * cqhci_crypto_debugfs_init - export keyslot statistics
+ * @cq_host: a cqhci host
+ *
+ * Keyslots are allocated and programmed by blk-crypto before a request
+ * reaches the driver, so a "miss" here is the first task to use a newly
+ * programmed keyslot.  A high miss to hit ratio means there are more
+ * active keys than keyslots.
+ */
+void cqhci_crypto_debugfs_init(struct cqhci_host *cq_host)
+{
+	struct mmc_host *mmc = cq_host->mmc;
+	struct dentry *root;
+
+	if (!(mmc->caps2 & MMC_CAP2_CRYPTO) || cq_host->crypto_debugfs ||
+	    !mmc->debugfs_root)
+		return;
+
+	root = debugfs_create_dir("cqhci_crypto", mmc->debugfs_root);
+	debugfs_create_u64("keyslot_hits", 0400, root,
+			   &cq_host->crypto_slot_hits);
+	debugfs_create_u64("keyslot_misses", 0400, root,
+			   &cq_host->crypto_slot_misses);
+	debugfs_create_u64("keyslot_programs", 0400, root,
+			   &cq_host->crypto_slot_programs);
+	debugfs_create_u64("keyslot_evicts", 0400, root,
+			   &cq_host->crypto_slot_evicts);
+	cq_host->crypto_debugfs = root;
+}
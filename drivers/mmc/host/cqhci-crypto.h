@@ -16,15 +16,24 @@
 
 int cqhci_crypto_init(struct cqhci_host *host);
 
+void cqhci_crypto_debugfs_init(struct cqhci_host *cq_host);
+
 /*
  * Returns the crypto bits that should be set in bits 64-127 of the
- * task descriptor.
+ * task descriptor.  The first task to use a keyslot after it was
+ * (re)programmed counts as a miss, later ones as hits.
  */
-static inline u64 cqhci_crypto_prep_task_desc(struct mmc_request *mrq)
+static inline u64 cqhci_crypto_prep_task_desc(struct cqhci_host *cq_host,
+					      struct mmc_request *mrq)
 {
 	if (!mrq->crypto_ctx)
 		return 0;
 
+	if (test_and_clear_bit(mrq->crypto_key_slot, cq_host->crypto_slot_fresh))
+		cq_host->crypto_slot_misses++;
+	else
+		cq_host->crypto_slot_hits++;
+
 	/* We set max_dun_bytes_supported=4, so all DUNs should be 32-bit. */
 	WARN_ON_ONCE(mrq->crypto_ctx->bc_dun[0] > U32_MAX);
 
@@ -40,7 +49,12 @@ static inline int cqhci_crypto_init(struct cqhci_host *host)
 	return 0;
 }
 
-static inline u64 cqhci_crypto_prep_task_desc(struct mmc_request *mrq)
+static inline void cqhci_crypto_debugfs_init(struct cqhci_host *cq_host)
+{
+}
+
+static inline u64 cqhci_crypto_prep_task_desc(struct cqhci_host *cq_host,
+					      struct mmc_request *mrq)
 {
 	return 0;
 }
@@ -123,6 +123,13 @@
 #define CQHCI_INT_ALL			0xF
 #define CQHCI_IC_DEFAULT_ICCTH		31
 #define CQHCI_IC_DEFAULT_ICTOVAL	1
+#define CQHCI_IC_MAX_ICCTH		0x1F
+#define CQHCI_IC_MAX_ICTOVAL		0x7F
+
+/* interrupt coalescing modes, see cqhci_ic_update() */
+#define CQHCI_IC_OFF			0
+#define CQHCI_IC_ON			1
+#define CQHCI_IC_ADAPTIVE		2
 
 /* attribute fields */
 #define CQHCI_VALID(x)			(((x) & 1) << 0)
@@ -262,6 +269,21 @@ struct cqhci_host {
 	/* same length as transfer descriptor */
 	u8 trans_desc_len;
 
+	/* shared transfer descriptor pool, see cqhci_prep_tran_desc() */
+	unsigned long *tdl_map;
+	unsigned int tdl_units;
+
+	/* interrupt coalescing tunables and the value last written to CQHCI_IC */
+	u32 ic_mode;
+	u8 ic_count;
+	u8 ic_timeout;
+	u32 ic_reg;
+
+	/* completion interrupt statistics, exported in debugfs */
+	u64 tcc_irqs;
+	u64 tcc_tasks;
+	struct dentry *debugfs;
+
 	dma_addr_t desc_dma_base;
 	dma_addr_t trans_desc_dma_base;
 
@@ -273,6 +295,15 @@ struct cqhci_host {
 	union cqhci_crypto_capabilities crypto_capabilities;
 	union cqhci_crypto_cap_entry *crypto_cap_array;
 	u32 crypto_cfg_register;
+
+	/* keyslots programmed but not yet used by a task */
+	unsigned long *crypto_slot_fresh;
+	/* keyslot statistics, exported in debugfs */
+	u64 crypto_slot_hits;
+	u64 crypto_slot_misses;
+	u64 crypto_slot_programs;
+	u64 crypto_slot_evicts;
+	struct dentry *crypto_debugfs;
 #endif
 };
 
@@ -39,6 +39,7 @@
 #include <linux/mmc/slot-gpio.h>
 
 #include "dw_mmc.h"
+#include "mmc_hsq.h"
 
 /* Common flag combinations */
 #define DW_MCI_DATA_ERROR_FLAGS	(SDMMC_INT_DRTO | SDMMC_INT_DCRC | \
@@ -62,6 +63,13 @@
 
 #define DESC_RING_BUF_SZ	PAGE_SIZE
 
+/*
+ * The descriptor memory holds two rings of DESC_RING_BUF_SZ each, so the
+ * next request's chain can be written by pre_req() while the IDMAC is
+ * still walking the current one.
+ */
+#define DESC_RING_NUM		2
+
 struct idmac_desc_64addr {
 	u32		des0;	/* Control Descriptor */
 #define IDMAC_OWN_CLR64(x) \
@@ -179,6 +187,8 @@ static void dw_mci_init_debugfs(struct dw_mci_slot *slot)
 	debugfs_create_file("regs", S_IRUSR, root, host, &dw_mci_regs_fops);
 	debugfs_create_file("req", S_IRUSR, root, slot, &dw_mci_req_fops);
 	debugfs_create_u32("state", S_IRUSR, root, &host->state);
+	debugfs_create_u32("dma_threshold", S_IRUSR | S_IWUSR, root,
+			   &host->dma_threshold);
 	debugfs_create_xul("pending_events", S_IRUSR, root,
 			   &host->pending_events);
 	debugfs_create_xul("completed_events", S_IRUSR, root,
@@ -189,6 +199,16 @@ static void dw_mci_init_debugfs(struct dw_mci_slot *slot)
 }
 #endif /* defined(CONFIG_DEBUG_FS) */
 
+/*
+ * The request state machine runs in the threaded half of our interrupt.
+ * Besides the hard IRQ handler, the DMA completion callback and the
+ * various timeout timers kick it from here.
+ */
+static inline void dw_mci_schedule_sm(struct dw_mci *host)
+{
+	irq_wake_thread(host->irq, host);
+}
+
 static bool dw_mci_ctrl_reset(struct dw_mci *host, u32 reset)
 {
 	u32 ctrl;
@@ -470,6 +490,12 @@ static void dw_mci_idmac_stop_dma(struct dw_mci *host)
 	temp &= ~(SDMMC_IDMAC_ENABLE | SDMMC_IDMAC_FB);
 	temp |= SDMMC_IDMAC_SWRESET;
 	mci_writel(host, BMOD, temp);
+
+	/*
+	 * The IDMAC won't release the rest of an aborted chain, so there
+	 * is nothing to wait for before that ring is written again.
+	 */
+	host->desc_count[host->desc_ring] = 0;
 }
 
 static void dw_mci_dmac_complete_dma(void *arg)
@@ -495,62 +521,81 @@ static void dw_mci_dmac_complete_dma(void *arg)
 	 */
 	if (data) {
 		set_bit(EVENT_XFER_COMPLETE, &host->pending_events);
-		tasklet_schedule(&host->tasklet);
+		dw_mci_schedule_sm(host);
 	}
 }
 
-static int dw_mci_idmac_init(struct dw_mci *host)
+static inline void *dw_mci_desc_ring(struct dw_mci *host, int ring)
 {
-	int i;
+	return host->sg_cpu + ring * DESC_RING_BUF_SZ;
+}
 
-	if (host->dma_64bit_address == 1) {
-		struct idmac_desc_64addr *p;
-		/* Number of descriptors in the ring buffer */
-		host->ring_size =
-			DESC_RING_BUF_SZ / sizeof(struct idmac_desc_64addr);
-
-		/* Forward link the descriptor list */
-		for (i = 0, p = host->sg_cpu; i < host->ring_size - 1;
-								i++, p++) {
-			p->des6 = (host->sg_dma +
-					(sizeof(struct idmac_desc_64addr) *
-							(i + 1))) & 0xffffffff;
-
-			p->des7 = (u64)(host->sg_dma +
-					(sizeof(struct idmac_desc_64addr) *
-							(i + 1))) >> 32;
-			/* Initialize reserved and buffer size fields to "0" */
-			p->des0 = 0;
-			p->des1 = 0;
-			p->des2 = 0;
-			p->des3 = 0;
-		}
+static inline dma_addr_t dw_mci_desc_ring_dma(struct dw_mci *host, int ring)
+{
+	return host->sg_dma + ring * DESC_RING_BUF_SZ;
+}
 
-		/* Set the last descriptor as the end-of-ring descriptor */
-		p->des6 = host->sg_dma & 0xffffffff;
-		p->des7 = (u64)host->sg_dma >> 32;
-		p->des0 = IDMAC_DES0_ER;
+static int dw_mci_idmac_init(struct dw_mci *host)
+{
+	int i, ring;
+
+	for (ring = 0; ring < DESC_RING_NUM; ring++) {
+		dma_addr_t ring_dma = dw_mci_desc_ring_dma(host, ring);
+
+		if (host->dma_64bit_address == 1) {
+			struct idmac_desc_64addr *p;
+			/* Number of descriptors in the ring buffer */
+			host->ring_size = DESC_RING_BUF_SZ /
+					  sizeof(struct idmac_desc_64addr);
+
+			/* Forward link the descriptor list */
+			for (i = 0, p = dw_mci_desc_ring(host, ring);
+			     i < host->ring_size - 1;
+			     i++, p++) {
+				p->des6 = (ring_dma +
+					   (sizeof(struct idmac_desc_64addr) *
+					    (i + 1))) & 0xffffffff;
+
+				p->des7 = (u64)(ring_dma +
+					   (sizeof(struct idmac_desc_64addr) *
+					    (i + 1))) >> 32;
+				/* Initialize reserved and buffer size fields to "0" */
+				p->des0 = 0;
+				p->des1 = 0;
+				p->des2 = 0;
+				p->des3 = 0;
+			}
 
-	} else {
-		struct idmac_desc *p;
-		/* Number of descriptors in the ring buffer */
-		host->ring_size =
-			DESC_RING_BUF_SZ / sizeof(struct idmac_desc);
-
-		/* Forward link the descriptor list */
-		for (i = 0, p = host->sg_cpu;
-		     i < host->ring_size - 1;
-		     i++, p++) {
-			p->des3 = cpu_to_le32(host->sg_dma +
+			/* Set the last descriptor as the end-of-ring descriptor */
+			p->des6 = ring_dma & 0xffffffff;
+			p->des7 = (u64)ring_dma >> 32;
+			p->des0 = IDMAC_DES0_ER;
+
+		} else {
+			struct idmac_desc *p;
+			/* Number of descriptors in the ring buffer */
+			host->ring_size =
+				DESC_RING_BUF_SZ / sizeof(struct idmac_desc);
+
+			/* Forward link the descriptor list */
+			for (i = 0, p = dw_mci_desc_ring(host, ring);
+			     i < host->ring_size - 1;
+			     i++, p++) {
+				p->des3 = cpu_to_le32(ring_dma +
 					(sizeof(struct idmac_desc) * (i + 1)));
-			p->des0 = 0;
-			p->des1 = 0;
+				p->des0 = 0;
+				p->des1 = 0;
+			}
+
+			/* Set the last descriptor as the end-of-ring descriptor */
+			p->des3 = cpu_to_le32(ring_dma);
+			p->des0 = cpu_to_le32(IDMAC_DES0_ER);
 		}
 
-		/* Set the last descriptor as the end-of-ring descriptor */
-		p->des3 = cpu_to_le32(host->sg_dma);
-		p->des0 = cpu_to_le32(IDMAC_DES0_ER);
+		host->desc_data[ring] = NULL;
+		host->desc_count[ring] = 0;
 	}
+	host->desc_ring = 0;
 
 	dw_mci_idmac_reset(host);
 
@@ -579,14 +624,27 @@ static int dw_mci_idmac_init(struct dw_mci *host)
 
 static inline int dw_mci_prepare_desc64(struct dw_mci *host,
 					 struct mmc_data *data,
-					 unsigned int sg_len)
+					 unsigned int sg_len, int ring)
 {
 	unsigned int desc_len;
 	struct idmac_desc_64addr *desc_first, *desc_last, *desc;
 	u32 val;
 	int i;
 
-	desc_first = desc_last = desc = host->sg_cpu;
+	desc_first = desc_last = desc = dw_mci_desc_ring(host, ring);
+
+	/*
+	 * Wait for the former clear OWN bit operation of IDMAC to make
+	 * sure that the last chain in this ring isn't still owned by
+	 * IDMAC as IDMAC's write ops and CPU's read ops are asynchronous.
+	 * The IDMAC releases descriptors in chain order, so checking the
+	 * last one is enough.
+	 */
+	if (host->desc_count[ring] &&
+	    readl_poll_timeout_atomic(&desc[host->desc_count[ring] - 1].des0,
+				      val, !(val & IDMAC_DES0_OWN),
+				      10, 100 * USEC_PER_MSEC))
+		goto err_own_bit;
 
 	for (i = 0; i < sg_len; i++) {
 		unsigned int length = sg_dma_len(&data->sg[i]);
@@ -599,17 +657,6 @@ static inline int dw_mci_prepare_desc64(struct dw_mci *host,
 
 			length -= desc_len;
 
-			/*
-			 * Wait for the former clear OWN bit operation
-			 * of IDMAC to make sure that this descriptor
-			 * isn't still owned by IDMAC as IDMAC's write
-			 * ops and CPU's read ops are asynchronous.
-			 */
-			if (readl_poll_timeout_atomic(&desc->des0, val,
-						!(val & IDMAC_DES0_OWN),
-						10, 100 * USEC_PER_MSEC))
-				goto err_own_bit;
-
 			/*
 			 * Set the OWN bit and disable interrupts
 			 * for this descriptor
@@ -639,11 +686,13 @@ static inline int dw_mci_prepare_desc64(struct dw_mci *host,
 	desc_last->des0 &= ~(IDMAC_DES0_CH | IDMAC_DES0_DIC);
 	desc_last->des0 |= IDMAC_DES0_LD;
 
+	host->desc_count[ring] = desc_last - desc_first + 1;
+
 	return 0;
 err_own_bit:
 	/* restore the descriptor chain as it's polluted */
 	dev_dbg(host->dev, "descriptor is still owned by IDMAC.\n");
-	memset(host->sg_cpu, 0, DESC_RING_BUF_SZ);
+	memset(host->sg_cpu, 0, DESC_RING_BUF_SZ * DESC_RING_NUM);
 	dw_mci_idmac_init(host);
 	return -EINVAL;
 }
@@ -651,14 +700,27 @@ err_own_bit:
 
 static inline int dw_mci_prepare_desc32(struct dw_mci *host,
 					 struct mmc_data *data,
-					 unsigned int sg_len)
+					 unsigned int sg_len, int ring)
 {
 	unsigned int desc_len;
 	struct idmac_desc *desc_first, *desc_last, *desc;
 	u32 val;
 	int i;
 
-	desc_first = desc_last = desc = host->sg_cpu;
+	desc_first = desc_last = desc = dw_mci_desc_ring(host, ring);
+
+	/*
+	 * Wait for the former clear OWN bit operation of IDMAC to make
+	 * sure that the last chain in this ring isn't still owned by
+	 * IDMAC as IDMAC's write ops and CPU's read ops are asynchronous.
+	 * The IDMAC releases descriptors in chain order, so checking the
+	 * last one is enough.
+	 */
+	if (host->desc_count[ring] &&
+	    readl_poll_timeout_atomic(&desc[host->desc_count[ring] - 1].des0,
+				      val, IDMAC_OWN_CLR64(val),
+				      10, 100 * USEC_PER_MSEC))
+		goto err_own_bit;
 
 	for (i = 0; i < sg_len; i++) {
 		unsigned int length = sg_dma_len(&data->sg[i]);
@@ -671,18 +733,6 @@ static inline int dw_mci_prepare_desc32(struct dw_mci *host,
 
 			length -= desc_len;
 
-			/*
-			 * Wait for the former clear OWN bit operation
-			 * of IDMAC to make sure that this descriptor
-			 * isn't still owned by IDMAC as IDMAC's write
-			 * ops and CPU's read ops are asynchronous.
-			 */
-			if (readl_poll_timeout_atomic(&desc->des0, val,
-						      IDMAC_OWN_CLR64(val),
-						      10,
-						      100 * USEC_PER_MSEC))
-				goto err_own_bit;
-
 			/*
 			 * Set the OWN bit and disable interrupts
 			 * for this descriptor
@@ -713,28 +763,129 @@ static inline int dw_mci_prepare_desc32(struct dw_mci *host,
 				       IDMAC_DES0_DIC));
 	desc_last->des0 |= cpu_to_le32(IDMAC_DES0_LD);
 
+	host->desc_count[ring] = desc_last - desc_first + 1;
+
 	return 0;
 err_own_bit:
 	/* restore the descriptor chain as it's polluted */
 	dev_dbg(host->dev, "descriptor is still owned by IDMAC.\n");
-	memset(host->sg_cpu, 0, DESC_RING_BUF_SZ);
+	memset(host->sg_cpu, 0, DESC_RING_BUF_SZ * DESC_RING_NUM);
 	dw_mci_idmac_init(host);
 	return -EINVAL;
 }
 
-static int dw_mci_idmac_start_dma(struct dw_mci *host, unsigned int sg_len)
+/* must be called with host->lock held */
+static int dw_mci_idmac_prepare(struct dw_mci *host, struct mmc_data *data,
+				unsigned int sg_len, int ring)
 {
-	u32 temp;
 	int ret;
 
+	host->desc_data[ring] = NULL;
+
 	if (host->dma_64bit_address == 1)
-		ret = dw_mci_prepare_desc64(host, host->data, sg_len);
+		ret = dw_mci_prepare_desc64(host, data, sg_len, ring);
 	else
-		ret = dw_mci_prepare_desc32(host, host->data, sg_len);
+		ret = dw_mci_prepare_desc32(host, data, sg_len, ring);
+
+	if (!ret)
+		host->desc_data[ring] = data;
+
+	return ret;
+}
+
+static bool dw_mci_idmac_ring_busy(struct dw_mci *host, int ring)
+{
+	unsigned int last = host->desc_count[ring] - 1;
+
+	if (!host->desc_count[ring])
+		return false;
+
+	if (host->dma_64bit_address == 1) {
+		struct idmac_desc_64addr *desc = dw_mci_desc_ring(host, ring);
+
+		return READ_ONCE(desc[last].des0) & IDMAC_DES0_OWN;
+	} else {
+		struct idmac_desc *desc = dw_mci_desc_ring(host, ring);
+
+		return !IDMAC_OWN_CLR64(READ_ONCE(desc[last].des0));
+	}
+}
+
+/*
+ * Give back a chain that was prepared but never started, so the ring
+ * doesn't look busy to dw_mci_idmac_ring_busy() forever.  Must be called
+ * with host->lock held.
+ */
+static void dw_mci_idmac_drop(struct dw_mci *host, int ring)
+{
+	unsigned int i;
+
+	if (host->dma_64bit_address == 1) {
+		struct idmac_desc_64addr *desc = dw_mci_desc_ring(host, ring);
+
+		for (i = 0; i < host->desc_count[ring]; i++)
+			desc[i].des0 &= ~IDMAC_DES0_OWN;
+	} else {
+		struct idmac_desc *desc = dw_mci_desc_ring(host, ring);
+
+		for (i = 0; i < host->desc_count[ring]; i++)
+			desc[i].des0 &= cpu_to_le32(~IDMAC_DES0_OWN);
+	}
+
+	host->desc_data[ring] = NULL;
+	host->desc_count[ring] = 0;
+}
+
+/*
+ * Write the descriptors for a request that is yet to be started into the
+ * ring the IDMAC isn't using, so starting it later only takes pointing
+ * the IDMAC at that ring.  Must be called with host->lock held.
+ */
+static void dw_mci_idmac_prefetch(struct dw_mci *host, struct mmc_data *data,
+				  unsigned int sg_len)
+{
+	int ring = !host->desc_ring;
+
+	/*
+	 * Don't wait here: the error path of the prepare helpers resets the
+	 * IDMAC, which must not happen under a running transfer.  Leave it
+	 * to start_dma() instead.
+	 */
+	if (dw_mci_idmac_ring_busy(host, ring))
+		return;
+
+	if (dw_mci_idmac_prepare(host, data, sg_len, ring))
+		dev_dbg(host->dev, "could not prepare descriptors early\n");
+}
+
+static int dw_mci_idmac_start_dma(struct dw_mci *host, unsigned int sg_len)
+{
+	struct mmc_data *data = host->data;
+	u32 temp;
+	int ring;
+	int ret = 0;
+
+	/*
+	 * Use the chain pre_req() wrote for this request, if any, else
+	 * rewrite the ring we ran last, which leaves a chain prepared in
+	 * the other one for a later request alone.
+	 */
+	for (ring = 0; ring < DESC_RING_NUM; ring++) {
+		if (host->desc_data[ring] == data)
+			break;
+	}
+	if (ring == DESC_RING_NUM) {
+		ring = host->desc_ring;
+		ret = dw_mci_idmac_prepare(host, data, sg_len, ring);
+	}
 
 	if (ret)
 		goto out;
 
+	/* The chain is about to be consumed; it can't be started again */
+	host->desc_data[ring] = NULL;
+	host->desc_ring = ring;
+
 	/* drain writebuffer */
 	wmb();
 
@@ -747,6 +898,16 @@ static int dw_mci_idmac_start_dma(struct dw_mci *host, unsigned int sg_len)
 	temp |= SDMMC_CTRL_USE_IDMAC;
 	mci_writel(host, CTRL, temp);
 
+	/* Point the IDMAC at the ring holding this chain */
+	if (host->dma_64bit_address == 1) {
+		dma_addr_t ring_dma = dw_mci_desc_ring_dma(host, ring);
+
+		mci_writel(host, DBADDRL, ring_dma & 0xffffffff);
+		mci_writel(host, DBADDRU, (u64)ring_dma >> 32);
+	} else {
+		mci_writel(host, DBADDR, dw_mci_desc_ring_dma(host, ring));
+	}
+
 	/* drain writebuffer */
 	wmb();
 
@@ -889,7 +1050,7 @@ static int dw_mci_pre_dma_transfer(struct dw_mci *host,
 	 * non-word-aligned buffers or lengths. Also, we don't bother
 	 * with all the DMA setup overhead for short transfers.
 	 */
-	if (data->blocks * data->blksz < DW_MCI_DMA_THRESHOLD)
+	if (data->blocks * data->blksz < READ_ONCE(host->dma_threshold))
 		return -EINVAL;
 
 	if (data->blksz & 3)
@@ -917,6 +1078,7 @@ static void dw_mci_pre_req(struct mmc_host *mmc,
 {
 	struct dw_mci_slot *slot = mmc_priv(mmc);
 	struct mmc_data *data = mrq->data;
+	int sg_len;
 
 	if (!slot->host->use_dma || !data)
 		return;
@@ -924,9 +1086,18 @@ static void dw_mci_pre_req(struct mmc_host *mmc,
 	/* This data might be unmapped at this time */
 	data->host_cookie = COOKIE_UNMAPPED;
 
-	if (dw_mci_pre_dma_transfer(slot->host, mrq->data,
-				COOKIE_PRE_MAPPED) < 0)
+	sg_len = dw_mci_pre_dma_transfer(slot->host, mrq->data,
+					 COOKIE_PRE_MAPPED);
+	if (sg_len < 0) {
 		data->host_cookie = COOKIE_UNMAPPED;
+		return;
+	}
+
+	if (slot->host->use_dma == TRANS_MODE_IDMAC) {
+		spin_lock_bh(&slot->host->lock);
+		dw_mci_idmac_prefetch(slot->host, data, sg_len);
+		spin_unlock_bh(&slot->host->lock);
+	}
 }
 
 static void dw_mci_post_req(struct mmc_host *mmc,
@@ -939,6 +1110,18 @@ static void dw_mci_post_req(struct mmc_host *mmc,
 	if (!slot->host->use_dma || !data)
 		return;
 
+	/* Drop a chain prepared for a request that never got started */
+	if (slot->host->use_dma == TRANS_MODE_IDMAC) {
+		int ring;
+
+		spin_lock_bh(&slot->host->lock);
+		for (ring = 0; ring < DESC_RING_NUM; ring++) {
+			if (slot->host->desc_data[ring] == data)
+				dw_mci_idmac_drop(slot->host, ring);
+		}
+		spin_unlock_bh(&slot->host->lock);
+	}
+
 	if (data->host_cookie != COOKIE_UNMAPPED)
 		dma_unmap_sg(slot->host->dev,
 			     data->sg,
@@ -1028,6 +1211,32 @@ done:
 	mci_writel(host, FIFOTH, fifoth_val);
 }
 
+/*
+ * The PIO handlers drain or fill whatever the FIFO holds per interrupt, so
+ * the fewer interrupts the better.  A transfer that fits in the FIFO gets a
+ * single RXDR once all of it has arrived; longer ones only interrupt when
+ * the FIFO is three quarters full, or down to a quarter for writes.
+ */
+static void dw_mci_adjust_fifoth_pio(struct dw_mci *host,
+				     struct mmc_data *data)
+{
+	u32 fifo_width = 1 << host->data_shift;
+	u32 words = DIV_ROUND_UP(data->blocks * data->blksz, fifo_width);
+	u32 fifo_depth = host->fifo_depth;
+	u32 rx_wmark, tx_wmark;
+
+	if (words <= fifo_depth) {
+		rx_wmark = words - 1;
+		tx_wmark = fifo_depth / 2;
+	} else {
+		rx_wmark = fifo_depth * 3 / 4 - 1;
+		tx_wmark = fifo_depth / 4;
+	}
+
+	mci_writel(host, FIFOTH, SDMMC_SET_FIFOTH(host->fifoth_val >> 28,
+						  rx_wmark, tx_wmark));
+}
+
 static void dw_mci_ctrl_thld(struct dw_mci *host, struct mmc_data *data)
 {
 	unsigned int blksz = data->blksz;
@@ -1182,15 +1391,15 @@ static void dw_mci_submit_data(struct dw_mci *host, struct mmc_data *data)
 		mci_writel(host, CTRL, temp);
 
 		/*
-		 * Use the initial fifoth_val for PIO mode. If wm_algined
-		 * is set, we set watermark same as data size.
+		 * Size the watermarks for PIO mode from the transfer length.
+		 * If wm_algined is set, we set watermark same as data size.
 		 * If next issued data may be transfered by DMA mode,
 		 * prev_blksz should be invalidated.
 		 */
 		if (host->wm_aligned)
 			dw_mci_adjust_fifoth(host, data);
 		else
-			mci_writel(host, FIFOTH, host->fifoth_val);
+			dw_mci_adjust_fifoth_pio(host, data);
 		host->prev_blksz = 0;
 	} else {
 		/*
@@ -1414,6 +1623,16 @@ static void dw_mci_queue_request(struct dw_mci *host, struct dw_mci_slot *slot,
 	}
 }
 
+static void dw_mci_finalize_request(struct dw_mci *host, struct mmc_host *mmc,
+				    struct mmc_request *mrq)
+{
+	/* Requests issued by the software queue are completed through it */
+	if (host->hsq && mmc_hsq_finalize_request(mmc, mrq))
+		return;
+
+	mmc_request_done(mmc, mrq);
+}
+
 static void dw_mci_request(struct mmc_host *mmc, struct mmc_request *mrq)
 {
 	struct dw_mci_slot *slot = mmc_priv(mmc);
@@ -1429,7 +1648,7 @@ static void dw_mci_request(struct mmc_host *mmc, struct mmc_request *mrq)
 
 	if (!dw_mci_get_cd(mmc)) {
 		mrq->cmd->error = -ENOMEDIUM;
-		mmc_request_done(mmc, mrq);
+		dw_mci_finalize_request(host, mmc, mrq);
 		return;
 	}
 
@@ -1440,6 +1659,36 @@ static void dw_mci_request(struct mmc_host *mmc, struct mmc_request *mrq)
 	spin_unlock_bh(&host->lock);
 }
 
+static int dw_mci_request_atomic(struct mmc_host *mmc, struct mmc_request *mrq)
+{
+	struct dw_mci_slot *slot = mmc_priv(mmc);
+	struct dw_mci *host = slot->host;
+
+	WARN_ON(slot->mrq);
+
+	/*
+	 * This may be called from the completion path of the previous
+	 * request, so we can neither sample a (possibly sleeping) card
+	 * detect GPIO nor poll for the card to leave busy.  Use the last
+	 * known card state, and have the caller retry from process context
+	 * through dw_mci_request() if the card is gone or still busy.
+	 */
+	if (!test_bit(DW_MMC_CARD_PRESENT, &slot->flags))
+		return -EBUSY;
+
+	if ((mrq->sbc || mrq->data) &&
+	    (mci_readl(host, STATUS) & SDMMC_STATUS_BUSY))
+		return -EBUSY;
+
+	spin_lock_bh(&host->lock);
+
+	dw_mci_queue_request(host, slot, mrq);
+
+	spin_unlock_bh(&host->lock);
+
+	return 0;
+}
+
 static void dw_mci_set_ios(struct mmc_host *mmc, struct mmc_ios *ios)
 {
 	struct dw_mci_slot *slot = mmc_priv(mmc);
@@ -1807,6 +2056,7 @@ ciu_out:
 
 static const struct mmc_host_ops dw_mci_ops = {
 	.request		= dw_mci_request,
+	.request_atomic		= dw_mci_request_atomic,
 	.pre_req		= dw_mci_pre_req,
 	.post_req		= dw_mci_post_req,
 	.set_ios		= dw_mci_set_ios,
@@ -1836,7 +2086,7 @@ static enum hrtimer_restart dw_mci_fault_timer(struct hrtimer *t)
 	if (!host->data_status) {
 		host->data_status = SDMMC_INT_DCRC;
 		set_bit(EVENT_DATA_ERROR, &host->pending_events);
-		tasklet_schedule(&host->tasklet);
+		dw_mci_schedule_sm(host);
 	}
 
 	spin_unlock_irqrestore(&host->irq_lock, flags);
@@ -1917,7 +2167,7 @@ static void dw_mci_request_end(struct dw_mci *host, struct mmc_request *mrq)
 	}
 
 	spin_unlock(&host->lock);
-	mmc_request_done(prev_mmc, mrq);
+	dw_mci_finalize_request(host, prev_mmc, mrq);
 	spin_lock(&host->lock);
 }
 
@@ -2058,9 +2308,9 @@ static bool dw_mci_clear_pending_data_complete(struct dw_mci *host)
 	return true;
 }
 
-static void dw_mci_tasklet_func(struct tasklet_struct *t)
+static irqreturn_t dw_mci_irq_thread(int irq, void *dev_id)
 {
-	struct dw_mci *host = from_tasklet(host, t, tasklet);
+	struct dw_mci *host = dev_id;
 	struct mmc_data	*data;
 	struct mmc_command *cmd;
 	struct mmc_request *mrq;
@@ -2068,7 +2318,7 @@ static void dw_mci_tasklet_func(struct tasklet_struct *t)
 	enum dw_mci_state prev_state;
 	unsigned int err;
 
-	spin_lock(&host->lock);
+	spin_lock_bh(&host->lock);
 
 	state = host->state;
 	data = host->data;
@@ -2115,7 +2365,7 @@ static void dw_mci_tasklet_func(struct tasklet_struct *t)
 				 * will waste a bit of time (we already know
 				 * the command was bad), it can't cause any
 				 * errors since it's possible it would have
-				 * taken place anyway if this tasklet got
+				 * taken place anyway if this thread got
 				 * delayed. Allowing the transfer to take place
 				 * avoids races and keeps things simple.
 				 */
@@ -2283,8 +2533,9 @@ static void dw_mci_tasklet_func(struct tasklet_struct *t)
 
 	host->state = state;
 unlock:
-	spin_unlock(&host->lock);
+	spin_unlock_bh(&host->lock);
 
+	return IRQ_HANDLED;
 }
 
 /* push final bytes to part_buf, only use during push */
@@ -2346,23 +2597,21 @@ static void dw_mci_push_data16(struct dw_mci *host, void *buf, int cnt)
 			u16 aligned_buf[64];
 			int len = min(cnt & -2, (int)sizeof(aligned_buf));
 			int items = len >> 1;
-			int i;
 			/* memcpy from input buffer into aligned buffer */
 			memcpy(aligned_buf, buf, len);
 			buf += len;
 			cnt -= len;
 			/* push data from aligned buffer into fifo */
-			for (i = 0; i < items; ++i)
-				mci_fifo_writew(host->fifo_reg, aligned_buf[i]);
+			mci_fifo_writesw(host->fifo_reg, aligned_buf, items);
 		}
 	} else
 #endif
 	{
-		u16 *pdata = buf;
+		int items = cnt >> 1;
 
-		for (; cnt >= 2; cnt -= 2)
-			mci_fifo_writew(host->fifo_reg, *pdata++);
-		buf = pdata;
+		mci_fifo_writesw(host->fifo_reg, buf, items);
+		buf += items << 1;
+		cnt -= items << 1;
 	}
 	/* put anything remaining in the part_buf */
 	if (cnt) {
@@ -2383,10 +2632,8 @@ static void dw_mci_pull_data16(struct dw_mci *host, void *buf, int cnt)
 			u16 aligned_buf[64];
 			int len = min(cnt & -2, (int)sizeof(aligned_buf));
 			int items = len >> 1;
-			int i;
 
-			for (i = 0; i < items; ++i)
-				aligned_buf[i] = mci_fifo_readw(host->fifo_reg);
+			mci_fifo_readsw(host->fifo_reg, aligned_buf, items);
 			/* memcpy from aligned buffer into output buffer */
 			memcpy(buf, aligned_buf, len);
 			buf += len;
@@ -2395,11 +2642,11 @@ static void dw_mci_pull_data16(struct dw_mci *host, void *buf, int cnt)
 	} else
 #endif
 	{
-		u16 *pdata = buf;
+		int items = cnt >> 1;
 
-		for (; cnt >= 2; cnt -= 2)
-			*pdata++ = mci_fifo_readw(host->fifo_reg);
-		buf = pdata;
+		mci_fifo_readsw(host->fifo_reg, buf, items);
+		buf += items << 1;
+		cnt -= items << 1;
 	}
 	if (cnt) {
 		host->part_buf16 = mci_fifo_readw(host->fifo_reg);
@@ -2429,23 +2676,21 @@ static void dw_mci_push_data32(struct dw_mci *host, void *buf, int cnt)
 			u32 aligned_buf[32];
 			int len = min(cnt & -4, (int)sizeof(aligned_buf));
 			int items = len >> 2;
-			int i;
 			/* memcpy from input buffer into aligned buffer */
 			memcpy(aligned_buf, buf, len);
 			buf += len;
 			cnt -= len;
 			/* push data from aligned buffer into fifo */
-			for (i = 0; i < items; ++i)
-				mci_fifo_writel(host->fifo_reg,	aligned_buf[i]);
+			mci_fifo_writesl(host->fifo_reg, aligned_buf, items);
 		}
 	} else
 #endif
 	{
-		u32 *pdata = buf;
+		int items = cnt >> 2;
 
-		for (; cnt >= 4; cnt -= 4)
-			mci_fifo_writel(host->fifo_reg, *pdata++);
-		buf = pdata;
+		mci_fifo_writesl(host->fifo_reg, buf, items);
+		buf += items << 2;
+		cnt -= items << 2;
 	}
 	/* put anything remaining in the part_buf */
 	if (cnt) {
@@ -2466,10 +2711,8 @@ static void dw_mci_pull_data32(struct dw_mci *host, void *buf, int cnt)
 			u32 aligned_buf[32];
 			int len = min(cnt & -4, (int)sizeof(aligned_buf));
 			int items = len >> 2;
-			int i;
 
-			for (i = 0; i < items; ++i)
-				aligned_buf[i] = mci_fifo_readl(host->fifo_reg);
+			mci_fifo_readsl(host->fifo_reg, aligned_buf, items);
 			/* memcpy from aligned buffer into output buffer */
 			memcpy(buf, aligned_buf, len);
 			buf += len;
@@ -2478,11 +2721,11 @@ static void dw_mci_pull_data32(struct dw_mci *host, void *buf, int cnt)
 	} else
 #endif
 	{
-		u32 *pdata = buf;
+		int items = cnt >> 2;
 
-		for (; cnt >= 4; cnt -= 4)
-			*pdata++ = mci_fifo_readl(host->fifo_reg);
-		buf = pdata;
+		mci_fifo_readsl(host->fifo_reg, buf, items);
+		buf += items << 2;
+		cnt -= items << 2;
 	}
 	if (cnt) {
 		host->part_buf32 = mci_fifo_readl(host->fifo_reg);
@@ -2708,7 +2951,7 @@ static void dw_mci_cmd_interrupt(struct dw_mci *host, u32 status)
 	smp_wmb(); /* drain writebuffer */
 
 	set_bit(EVENT_CMD_COMPLETE, &host->pending_events);
-	tasklet_schedule(&host->tasklet);
+	dw_mci_schedule_sm(host);
 
 	dw_mci_start_fault_timer(host);
 }
@@ -2776,7 +3019,7 @@ static irqreturn_t dw_mci_interrupt(int irq, void *dev_id)
 				set_bit(EVENT_DATA_COMPLETE,
 					&host->pending_events);
 
-			tasklet_schedule(&host->tasklet);
+			dw_mci_schedule_sm(host);
 
 			spin_unlock(&host->irq_lock);
 		}
@@ -2795,7 +3038,7 @@ static irqreturn_t dw_mci_interrupt(int irq, void *dev_id)
 					dw_mci_read_data_pio(host, true);
 			}
 			set_bit(EVENT_DATA_COMPLETE, &host->pending_events);
-			tasklet_schedule(&host->tasklet);
+			dw_mci_schedule_sm(host);
 
 			spin_unlock(&host->irq_lock);
 		}
@@ -2973,6 +3216,26 @@ static int dw_mci_init_slot(struct dw_mci *host)
 		mmc->max_seg_size = mmc->max_req_size;
 	}
 
+	/*
+	 * With IDMAC, let the software queue start the next request's
+	 * descriptor chain right from the completion of the previous one.
+	 */
+	if (host->use_dma == TRANS_MODE_IDMAC) {
+		struct mmc_hsq *hsq;
+
+		hsq = devm_kzalloc(host->dev, sizeof(*hsq), GFP_KERNEL);
+		if (!hsq) {
+			ret = -ENOMEM;
+			goto err_host_allocated;
+		}
+
+		ret = mmc_hsq_init(hsq, mmc);
+		if (ret)
+			goto err_host_allocated;
+
+		host->hsq = hsq;
+	}
+
 	dw_mci_get_cd(mmc);
 
 	ret = mmc_add_host(mmc);
@@ -3049,7 +3312,7 @@ static void dw_mci_init_dma(struct dw_mci *host)
 
 		/* Alloc memory for sg translation */
 		host->sg_cpu = dmam_alloc_coherent(host->dev,
-						   DESC_RING_BUF_SZ,
+						   DESC_RING_BUF_SZ * DESC_RING_NUM,
 						   &host->sg_dma, GFP_KERNEL);
 		if (!host->sg_cpu) {
 			dev_err(host->dev,
@@ -3100,7 +3363,7 @@ static void dw_mci_cmd11_timer(struct timer_list *t)
 
 	host->cmd_status = SDMMC_INT_RTO;
 	set_bit(EVENT_CMD_COMPLETE, &host->pending_events);
-	tasklet_schedule(&host->tasklet);
+	dw_mci_schedule_sm(host);
 }
 
 static void dw_mci_cto_timer(struct timer_list *t)
@@ -3146,7 +3409,7 @@ static void dw_mci_cto_timer(struct timer_list *t)
 		 */
 		host->cmd_status = SDMMC_INT_RTO;
 		set_bit(EVENT_CMD_COMPLETE, &host->pending_events);
-		tasklet_schedule(&host->tasklet);
+		dw_mci_schedule_sm(host);
 		break;
 	default:
 		dev_warn(host->dev, "Unexpected command timeout, state %d\n",
@@ -3197,7 +3460,7 @@ static void dw_mci_dto_timer(struct timer_list *t)
 		host->data_status = SDMMC_INT_DRTO;
 		set_bit(EVENT_DATA_ERROR, &host->pending_events);
 		set_bit(EVENT_DATA_COMPLETE, &host->pending_events);
-		tasklet_schedule(&host->tasklet);
+		dw_mci_schedule_sm(host);
 		break;
 	default:
 		dev_warn(host->dev, "Unexpected data timeout, state %d\n",
@@ -3415,6 +3678,7 @@ int dw_mci_probe(struct dw_mci *host)
 		fifo_size = host->pdata->fifo_depth;
 	}
 	host->fifo_depth = fifo_size;
+	host->dma_threshold = DW_MCI_DMA_THRESHOLD;
 	host->fifoth_val =
 		SDMMC_SET_FIFOTH(0x2, fifo_size / 2 - 1, fifo_size / 2);
 	mci_writel(host, FIFOTH, host->fifoth_val);
@@ -3437,9 +3701,9 @@ int dw_mci_probe(struct dw_mci *host)
 	else
 		host->fifo_reg = host->regs + DATA_240A_OFFSET;
 
-	tasklet_setup(&host->tasklet, dw_mci_tasklet_func);
-	ret = devm_request_irq(host->dev, host->irq, dw_mci_interrupt,
-			       host->irq_flags, "dw-mci", host);
+	ret = devm_request_threaded_irq(host->dev, host->irq, dw_mci_interrupt,
+					dw_mci_irq_thread, host->irq_flags,
+					"dw-mci", host);
 	if (ret)
 		goto err_dmaunmap;
 
@@ -3515,6 +3779,9 @@ int dw_mci_runtime_suspend(struct device *dev)
 {
 	struct dw_mci *host = dev_get_drvdata(dev);
 
+	if (host->hsq)
+		mmc_hsq_suspend(host->slot->mmc);
+
 	if (host->use_dma && host->dma_ops->exit)
 		host->dma_ops->exit(host);
 
@@ -3585,6 +3852,9 @@ int dw_mci_runtime_resume(struct device *dev)
 	/* Now that slots are all setup, we can enable card detect */
 	dw_mci_enable_cd(host);
 
+	if (host->hsq)
+		mmc_hsq_resume(host->slot->mmc);
+
 	return 0;
 
 err:
@@ -43,6 +43,7 @@ enum dw_mci_cookie {
 };
 
 struct mmc_data;
+struct mmc_hsq;
 
 enum {
 	TRANS_MODE_PIO = 0,
@@ -81,6 +82,10 @@ struct dw_mci_dma_slave {
  * @cmd_status: Snapshot of SR taken upon completion of the current
  * @ring_size: Buffer size for idma descriptors.
  *	command. Only valid when EVENT_CMD_COMPLETE is pending.
+ * @desc_data: Request data whose chain is prepared, but not yet started,
+ *	in each of the two descriptor rings.
+ * @desc_count: Number of descriptors in the last chain of each ring.
+ * @desc_ring: The descriptor ring the IDMAC was last started on.
  * @dms: structure of slave-dma private data.
  * @phy_regs: physical address of controller's register map
  * @data_status: Snapshot of SR taken upon completion of the current
@@ -89,18 +94,18 @@ struct dw_mci_dma_slave {
  * @stop_cmdr: Value to be loaded into CMDR when the stop command is
  *	to be sent.
  * @dir_status: Direction of current transfer.
- * @tasklet: Tasklet running the request state machine.
  * @pending_events: Bitmask of events flagged by the interrupt handler
- *	to be processed by the tasklet.
+ *	to be processed by the threaded interrupt handler.
  * @completed_events: Bitmask of events which the state machine has
  *	processed.
- * @state: Tasklet state.
+ * @state: Request state machine state.
  * @queue: List of slots waiting for access to the controller.
  * @bus_hz: The rate of @mck in Hz. This forms the basis for MMC bus
  *	rate and timeout calculations.
  * @current_speed: Configured rate of the controller.
  * @minimum_speed: Stored minimum rate of the controller.
  * @fifoth_val: The value of FIFOTH register.
+ * @dma_threshold: Transfers shorter than this many bytes are done by PIO.
  * @verid: Denote Version ID.
  * @dev: Device associated with the MMC controller.
  * @pdata: Platform data associated with the MMC controller.
@@ -123,6 +128,7 @@ struct dw_mci_dma_slave {
  * @vqmmc_enabled: Status of vqmmc, should be true or false.
  * @irq_flags: The flags to be passed to request_irq.
  * @irq: The irq value to be passed to request_irq.
+ * @hsq: Host software queue, or NULL if it is not used.
  * @sdio_id0: Number of slot0 in the SDIO interrupt registers.
  * @cmd11_timer: Timer for SD3.0 voltage switch over scheme.
  * @cto_timer: Timer for broken command transfer over scheme.
@@ -184,6 +190,9 @@ struct dw_mci {
 	const struct dw_mci_dma_ops	*dma_ops;
 	/* For idmac */
 	unsigned int		ring_size;
+	struct mmc_data		*desc_data[2];
+	unsigned int		desc_count[2];
+	int			desc_ring;
 
 	/* For edmac */
 	struct dw_mci_dma_slave *dms;
@@ -194,7 +203,6 @@ struct dw_mci {
 	u32			data_status;
 	u32			stop_cmdr;
 	u32			dir_status;
-	struct tasklet_struct	tasklet;
 	unsigned long		pending_events;
 	unsigned long		completed_events;
 	enum dw_mci_state	state;
@@ -204,6 +212,7 @@ struct dw_mci {
 	u32			current_speed;
 	u32			minimum_speed;
 	u32			fifoth_val;
+	u32			dma_threshold;
 	u16			verid;
 	struct device		*dev;
 	struct dw_mci_board	*pdata;
@@ -231,6 +240,8 @@ struct dw_mci {
 	unsigned long		irq_flags; /* IRQ flags */
 	int			irq;
 
+	struct mmc_hsq		*hsq;
+
 	int			sdio_id0;
 
 	struct timer_list       cmd11_timer;
@@ -471,6 +482,13 @@ struct dw_mci_board {
 #define mci_fifo_writel(__value, __reg)	__raw_writel(__reg, __value)
 #define mci_fifo_writeq(__value, __reg)	__raw_writeq(__reg, __value)
 
+/* FIFO burst access macros, same endian-ness rules as above */
+#define mci_fifo_readsw(__reg, __buf, __count)	readsw(__reg, __buf, __count)
+#define mci_fifo_readsl(__reg, __buf, __count)	readsl(__reg, __buf, __count)
+
+#define mci_fifo_writesw(__reg, __buf, __count)	writesw(__reg, __buf, __count)
+#define mci_fifo_writesl(__reg, __buf, __count)	writesl(__reg, __buf, __count)
+
 /* Register access macros */
 #define mci_readl(dev, reg)			\
 	readl_relaxed((dev)->regs + SDMMC_##reg)
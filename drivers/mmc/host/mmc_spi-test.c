@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <kunit/test.h>
+#include <linux/ktime.h>
+#include <linux/random.h>
+
+#define MMC_SPI_TEST_ROUNDS	2000
+
+static void mmc_spi_crc16_known(struct kunit *test)
+{
+	static const u8 check[] = "123456789";
+	u8 *buf;
+
+	/* CRC-16/XMODEM check value */
+	KUNIT_EXPECT_EQ(test, 0x31c3,
+			mmc_spi_crc16(check, sizeof(check) - 1));
+
+	/* SD spec example: a 512 byte block of 0xff */
+	buf = kunit_kmalloc(test, MMC_SPI_BLOCKSIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, buf);
+	memset(buf, 0xff, MMC_SPI_BLOCKSIZE);
+	KUNIT_EXPECT_EQ(test, 0x7fa1, mmc_spi_crc16(buf, MMC_SPI_BLOCKSIZE));
+}
+
+static void mmc_spi_crc16_matches_crc_itu_t(struct kunit *test)
+{
+	unsigned int len;
+	u8 *buf;
+
+	buf = kunit_kmalloc(test, MMC_SPI_BLOCKSIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, buf);
+	get_random_bytes(buf, MMC_SPI_BLOCKSIZE);
+
+	/* cover every tail length of the slice-by-8 loop */
+	for (len = 0; len <= MMC_SPI_BLOCKSIZE; len++)
+		KUNIT_EXPECT_EQ_MSG(test, crc_itu_t(0, buf, len),
+				    mmc_spi_crc16(buf, len), "len %u", len);
+}
+
+static void mmc_spi_crc16_bench(struct kunit *test)
+{
+	u16 crc_ref = 0, crc_fast = 0;
+	u64 t_ref, t_fast;
+	ktime_t start;
+	unsigned int i;
+	u8 *buf;
+
+	buf = kunit_kmalloc(test, MMC_SPI_BLOCKSIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, buf);
+	get_random_bytes(buf, MMC_SPI_BLOCKSIZE);
+
+	start = ktime_get();
+	for (i = 0; i < MMC_SPI_TEST_ROUNDS; i++)
+		crc_ref ^= crc_itu_t(0, buf, MMC_SPI_BLOCKSIZE);
+	t_ref = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	start = ktime_get();
+	for (i = 0; i < MMC_SPI_TEST_ROUNDS; i++)
+		crc_fast ^= mmc_spi_crc16(buf, MMC_SPI_BLOCKSIZE);
+	t_fast = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	KUNIT_EXPECT_EQ(test, crc_ref, crc_fast);
+
+	kunit_info(test, "crc_itu_t:     %llu ns per %d byte block\n",
+		   div_u64(t_ref, MMC_SPI_TEST_ROUNDS), MMC_SPI_BLOCKSIZE);
+	kunit_info(test, "mmc_spi_crc16: %llu ns per %d byte block\n",
+		   div_u64(t_fast, MMC_SPI_TEST_ROUNDS), MMC_SPI_BLOCKSIZE);
+}
+
+static int mmc_spi_test_init(struct kunit_suite *suite)
+{
+	mmc_spi_crc16_init();
+	return 0;
+}
+
+static struct kunit_case mmc_spi_test_cases[] = {
+	KUNIT_CASE(mmc_spi_crc16_known),
+	KUNIT_CASE(mmc_spi_crc16_matches_crc_itu_t),
+	KUNIT_CASE(mmc_spi_crc16_bench),
+	{}
+};
+
+static struct kunit_suite mmc_spi_test_suite = {
+	.name = "mmc_spi",
+	.suite_init = mmc_spi_test_init,
+	.test_cases = mmc_spi_test_cases,
+};
+
+kunit_test_suite(mmc_spi_test_suite);
@@ -89,6 +89,25 @@
  */
 #define MMC_SPI_BLOCKSATONCE	128
 
+/* Multiblock reads may be streamed instead of being handled one block
+ * (and one spi_sync) at a time:  the card keeps sending N(AC) padding,
+ * tokens, data and CRCs for as long as we keep clocking, so we can read
+ * the raw byte stream in large chunks and pick the blocks out of it.
+ * Two chunk buffers are used, so the next chunk is already queued with
+ * the SPI controller while the previous one is parsed.  Each chunk is
+ * built from transfers of at most MMC_SPI_BLOCKSIZE bytes, since that
+ * is the size of our all-ones TX buffer.
+ */
+#define MMC_SPI_PIPE_XFERS	8
+#define MMC_SPI_PIPE_BUFSIZE	(MMC_SPI_PIPE_XFERS * MMC_SPI_BLOCKSIZE)
+
+/* Stop trying the streamed read path after this many consecutive errors */
+#define MMC_SPI_PIPE_MAX_ERRORS	8
+
+static bool pipeline = true;
+module_param(pipeline, bool, 0644);
+MODULE_PARM_DESC(pipeline, "Stream multiblock transfers instead of syncing each block");
+
 /****************************************************************************/
 
 /*
@@ -132,9 +151,87 @@ struct mmc_spi_host {
 	 */
 	void			*ones;
 	dma_addr_t		ones_dma;
+
+	/* for streamed multiblock reads */
+	struct spi_transfer	pipe_xfer[2][MMC_SPI_PIPE_XFERS];
+	struct spi_message	pipe_msg[2];
+	struct completion	pipe_done[2];
+	u8			*pipe_buf[2];
+	u8			*pipe_blk;
+	unsigned int		pipe_errors;
+	bool			pipe_fallback;
+
+	/* CRC of the next block to write, computed while the current
+	 * block is still on the wire
+	 */
+	__be16			crc_ahead;
+	bool			crc_ahead_valid;
+};
+
+/* Parser state for a streamed multiblock read */
+struct mmc_spi_stream {
+	struct mmc_data		*data;
+	unsigned int		blksz;
+	unsigned int		blocks;		/* still to be received */
+	unsigned int		pos;		/* data+crc bytes gathered */
+	bool			seeking;	/* looking for a start token */
+	bool			first;		/* first byte after a block */
+	unsigned int		bitshift;
+	u8			leftover;
 };
 
 
+/****************************************************************************/
+
+/*
+ * Data block CRC16 (CRC-ITU-T, as crc_itu_t() computes it)
+ *
+ * With use_spi_crc on, every data block is checksummed by the CPU, and
+ * the byte-at-a-time crc_itu_t() loop is a real cost on the slow cores
+ * that typically drive SD over SPI.  Use slice-by-8 instead:  table k
+ * holds the CRC of a byte followed by k zero bytes, so eight bytes are
+ * folded in with eight independent lookups.
+ *
+ * The command CRC7 only covers five bytes per command, so crc7_be() is
+ * good enough there.
+ */
+static u16 mmc_spi_crc16_table[8][256] __read_mostly;
+
+static void mmc_spi_crc16_init(void)
+{
+	unsigned int i, k;
+
+	for (i = 0; i < 256; i++) {
+		u16 crc = crc_itu_t_table[i];
+
+		mmc_spi_crc16_table[0][i] = crc;
+		for (k = 1; k < 8; k++) {
+			crc = (crc << 8) ^ crc_itu_t_table[crc >> 8];
+			mmc_spi_crc16_table[k][i] = crc;
+		}
+	}
+}
+
+static u16 mmc_spi_crc16(const u8 *buf, size_t len)
+{
+	const u16 (*t)[256] = mmc_spi_crc16_table;
+	u16 crc = 0;
+
+	while (len >= 8) {
+		crc = t[7][buf[0] ^ (crc >> 8)] ^
+		      t[6][buf[1] ^ (crc & 0xff)] ^
+		      t[5][buf[2]] ^ t[4][buf[3]] ^
+		      t[3][buf[4]] ^ t[2][buf[5]] ^
+		      t[1][buf[6]] ^ t[0][buf[7]];
+		buf += 8;
+		len -= 8;
+	}
+	while (len--)
+		crc = crc_itu_t_byte(crc, *buf++);
+
+	return crc;
+}
+
 /****************************************************************************/
 
 /*
@@ -630,6 +727,38 @@ mmc_spi_setup_data_message(
 	}
 }
 
+static void mmc_spi_complete(void *context)
+{
+	complete(context);
+}
+
+/*
+ * Run the per-block data message.  When the following block's data is
+ * already known, queue the message asynchronously and compute that
+ * block's CRC while this one is being shifted out.
+ */
+static int mmc_spi_sync_block(struct mmc_spi_host *host,
+		const void *next, unsigned int next_len)
+{
+	DECLARE_COMPLETION_ONSTACK(done);
+	int status;
+
+	if (!next_len)
+		return spi_sync_locked(host->spi, &host->m);
+
+	host->m.complete = mmc_spi_complete;
+	host->m.context = &done;
+	status = spi_async_locked(host->spi, &host->m);
+	if (status)
+		return status;
+
+	host->crc_ahead = cpu_to_be16(mmc_spi_crc16(next, next_len));
+	host->crc_ahead_valid = true;
+
+	wait_for_completion(&done);
+	return host->m.status;
+}
+
 /*
  * Write one block:
  *  - caller handled preceding N(WR) [1+] all-ones bytes
@@ -640,27 +769,39 @@ mmc_spi_setup_data_message(
  *  - an all-ones byte ... card writes a data-response byte
  *  - followed by N(EC) [0+] all-ones bytes, card writes zero/'busy'
  *
+ * When next_len is nonzero, the block following this one in the same
+ * segment gets its CRC computed while this block is in flight.
+ *
  * Return negative errno, else success.
  */
 static int
 mmc_spi_writeblock(struct mmc_spi_host *host, struct spi_transfer *t,
-	unsigned long timeout)
+	unsigned long timeout, unsigned int next_len)
 {
 	struct spi_device	*spi = host->spi;
 	int			status, i;
 	struct scratch		*scratch = host->data;
 	u32			pattern;
 
-	if (host->mmc->use_spi_crc)
-		scratch->crc_val = cpu_to_be16(crc_itu_t(0, t->tx_buf, t->len));
+	if (host->mmc->use_spi_crc) {
+		if (host->crc_ahead_valid)
+			scratch->crc_val = host->crc_ahead;
+		else
+			scratch->crc_val = cpu_to_be16(mmc_spi_crc16(t->tx_buf, t->len));
+	} else {
+		next_len = 0;
+	}
+	host->crc_ahead_valid = false;
+
 	if (host->dma_dev)
 		dma_sync_single_for_device(host->dma_dev,
 				host->data_dma, sizeof(*scratch),
 				DMA_BIDIRECTIONAL);
 
-	status = spi_sync_locked(spi, &host->m);
+	status = mmc_spi_sync_block(host, t->tx_buf + t->len, next_len);
 
 	if (status != 0) {
+		host->crc_ahead_valid = false;
 		dev_dbg(&spi->dev, "write error (%d)\n", status);
 		return status;
 	}
@@ -712,6 +853,7 @@ mmc_spi_writeblock(struct mmc_spi_host *host, struct spi_transfer *t,
 		break;
 	}
 	if (status != 0) {
+		host->crc_ahead_valid = false;
 		dev_dbg(&spi->dev, "write error %02x (%d)\n",
 			scratch->status[0], status);
 		return status;
@@ -829,7 +971,7 @@ mmc_spi_readblock(struct mmc_spi_host *host, struct spi_transfer *t,
 	}
 
 	if (host->mmc->use_spi_crc) {
-		u16 crc = crc_itu_t(0, t->rx_buf, t->len);
+		u16 crc = mmc_spi_crc16(t->rx_buf, t->len);
 
 		be16_to_cpus(&scratch->crc_val);
 		if (scratch->crc_val != crc) {
@@ -847,6 +989,212 @@ mmc_spi_readblock(struct mmc_spi_host *host, struct spi_transfer *t,
 	return 0;
 }
 
+/* Bytes still needed to finish the read, assuming no more padding */
+static unsigned int mmc_spi_stream_left(struct mmc_spi_stream *st)
+{
+	unsigned int left = st->blocks * (1 + st->blksz + 2);
+
+	if (!st->seeking)
+		left -= 1 + st->pos;
+	return left;
+}
+
+static int mmc_spi_stream_block(struct mmc_spi_host *host,
+		struct mmc_spi_stream *st)
+{
+	struct mmc_data	*data = st->data;
+	u8		*blk = host->pipe_blk;
+
+	if (host->mmc->use_spi_crc) {
+		u16 crc_val = get_unaligned_be16(blk + st->blksz);
+		u16 crc = mmc_spi_crc16(blk, st->blksz);
+
+		if (crc_val != crc) {
+			dev_dbg(&host->spi->dev,
+				"read - crc error: crc_val=0x%04x, computed=0x%04x len=%d\n",
+				crc_val, crc, st->blksz);
+			return -EILSEQ;
+		}
+	}
+
+	if (sg_pcopy_from_buffer(data->sg, data->sg_len, blk, st->blksz,
+				 data->bytes_xfered) != st->blksz)
+		return -EFAULT;
+
+	data->bytes_xfered += st->blksz;
+	st->blocks--;
+	st->seeking = true;
+	st->first = true;
+	return 0;
+}
+
+/*
+ * Pick data blocks out of a chunk of the raw read stream.  This does the
+ * same token scanning and bit realignment as mmc_spi_readblock(), except
+ * that the state is kept across chunk boundaries.
+ */
+static int mmc_spi_stream_parse(struct mmc_spi_host *host,
+		struct mmc_spi_stream *st, const u8 *buf, unsigned int len)
+{
+	unsigned int	i = 0;
+	int		status;
+
+	while (i < len && st->blocks) {
+		unsigned int	n;
+		u8		*cp;
+
+		if (st->seeking) {
+			u8	token = buf[i++];
+			bool	first = st->first;
+
+			st->first = false;
+			if (token == 0xff || (token == 0 && first))
+				continue;
+
+			/* the first 0-bit precedes the data stream */
+			st->bitshift = 7;
+			while (token & 0x80) {
+				token <<= 1;
+				st->bitshift--;
+			}
+			st->leftover = token << 1;
+			st->seeking = false;
+			st->pos = 0;
+			continue;
+		}
+
+		n = min(len - i, st->blksz + 2 - st->pos);
+		cp = host->pipe_blk + st->pos;
+		if (st->bitshift) {
+			unsigned int	bitright = 8 - st->bitshift;
+			unsigned int	j;
+
+			for (j = 0; j < n; j++) {
+				u8 temp = buf[i + j];
+
+				*cp++ = st->leftover | (temp >> st->bitshift);
+				st->leftover = temp << bitright;
+			}
+		} else {
+			memcpy(cp, buf + i, n);
+		}
+		st->pos += n;
+		i += n;
+
+		if (st->pos == st->blksz + 2) {
+			status = mmc_spi_stream_block(host, st);
+			if (status < 0)
+				return status;
+		}
+	}
+	return 0;
+}
+
+static int mmc_spi_stream_submit(struct mmc_spi_host *host, int b,
+		unsigned int len)
+{
+	struct spi_transfer	*t = host->pipe_xfer[b];
+	unsigned int		n = DIV_ROUND_UP(len, MMC_SPI_BLOCKSIZE);
+	unsigned int		i;
+
+	memset(t, 0, n * sizeof(*t));
+	for (i = 0; i < n; i++) {
+		t[i].tx_buf = host->ones;
+		t[i].rx_buf = host->pipe_buf[b] + i * MMC_SPI_BLOCKSIZE;
+		t[i].len = min_t(unsigned int, len, MMC_SPI_BLOCKSIZE);
+		len -= t[i].len;
+	}
+	/* leave chipselect active for the next chunk or command */
+	t[n - 1].cs_change = 1;
+
+	spi_message_init_with_transfers(&host->pipe_msg[b], t, n);
+	host->pipe_msg[b].complete = mmc_spi_complete;
+	host->pipe_msg[b].context = &host->pipe_done[b];
+	reinit_completion(&host->pipe_done[b]);
+
+	return spi_async_locked(host->spi, &host->pipe_msg[b]);
+}
+
+/*
+ * Streamed multiblock read.  Chunks are never longer than what is still
+ * needed if the card sends no more padding, so we don't clock data past
+ * the end of the request; when the card does pad, more chunks follow.
+ */
+static int mmc_spi_read_stream(struct mmc_spi_host *host,
+		struct mmc_data *data, u32 blk_size, unsigned long timeout)
+{
+	struct mmc_spi_stream	st = {
+		.data		= data,
+		.blksz		= blk_size,
+		.blocks		= data->blocks,
+		.seeking	= true,
+		.first		= true,
+	};
+	unsigned int		len[2] = { 0, 0 };
+	unsigned long		deadline = jiffies + timeout;
+	int			cur = 0;
+	int			status;
+
+	len[cur] = min_t(unsigned int, mmc_spi_stream_left(&st),
+			 MMC_SPI_PIPE_BUFSIZE);
+	status = mmc_spi_stream_submit(host, cur, len[cur]);
+	if (status)
+		return status;
+
+	for (;;) {
+		int		next = cur ^ 1;
+		unsigned int	left = mmc_spi_stream_left(&st);
+		unsigned int	done_blocks = st.blocks;
+
+		/* keep the controller busy while we parse this chunk */
+		if (left > len[cur]) {
+			len[next] = min_t(unsigned int, left - len[cur],
+					  MMC_SPI_PIPE_BUFSIZE);
+			status = mmc_spi_stream_submit(host, next, len[next]);
+			if (status) {
+				len[next] = 0;
+				break;
+			}
+		}
+
+		wait_for_completion(&host->pipe_done[cur]);
+		status = host->pipe_msg[cur].status;
+		if (!status)
+			status = mmc_spi_stream_parse(host, &st,
+					host->pipe_buf[cur], len[cur]);
+		len[cur] = 0;
+		if (status || !st.blocks)
+			break;
+
+		if (st.blocks != done_blocks || !st.seeking)
+			deadline = jiffies + timeout;
+		else if (time_is_before_jiffies(deadline)) {
+			status = -ETIMEDOUT;
+			break;
+		}
+
+		/* the card padded more than expected: ask for more */
+		if (!len[next]) {
+			len[next] = min_t(unsigned int,
+					  mmc_spi_stream_left(&st),
+					  MMC_SPI_PIPE_BUFSIZE);
+			status = mmc_spi_stream_submit(host, next, len[next]);
+			if (status) {
+				len[next] = 0;
+				break;
+			}
+		}
+		cur = next;
+	}
+
+	/* never leave a message queued on error */
+	for (cur = 0; cur < 2; cur++) {
+		if (len[cur])
+			wait_for_completion(&host->pipe_done[cur]);
+	}
+	return status;
+}
+
 /*
  * An MMC/SD data stage includes one or more blocks, optional CRCs,
  * and inline handshaking.  That handhaking makes it unlike most
@@ -879,6 +1227,30 @@ mmc_spi_data_do(struct mmc_spi_host *host, struct mmc_command *cmd,
 		  data->timeout_clks * 1000000 / clock_rate;
 	timeout = usecs_to_jiffies((unsigned int)timeout) + 1;
 
+	/* Stream multiblock reads when we can, else (e.g. after an error in
+	 * the streamed path) fall back to the block-at-a-time code below.
+	 */
+	if (direction == DMA_FROM_DEVICE && multiple && pipeline &&
+	    !host->pipe_fallback && blk_size <= MMC_SPI_BLOCKSIZE) {
+		int status;
+
+		dev_dbg(&spi->dev, "    read stream, %d blocks\n", data->blocks);
+
+		status = mmc_spi_read_stream(host, data, blk_size, timeout);
+		if (status < 0) {
+			data->error = status;
+			host->pipe_fallback = true;
+			if (++host->pipe_errors == MMC_SPI_PIPE_MAX_ERRORS)
+				dev_warn(&spi->dev,
+					 "too many read stream errors, using per-block reads\n");
+			dev_dbg(&spi->dev, "read stream status %d\n", status);
+		} else {
+			host->pipe_errors = 0;
+		}
+		return;
+	}
+	host->crc_ahead_valid = false;
+
 	/* Handle scatterlist segments one at a time, with synch for
 	 * each 512-byte block
 	 */
@@ -923,9 +1295,14 @@ mmc_spi_data_do(struct mmc_spi_host *host, struct mmc_command *cmd,
 
 			dev_dbg(&spi->dev, "    %s block, %d bytes\n", write_or_read, t->len);
 
-			if (direction == DMA_TO_DEVICE)
-				status = mmc_spi_writeblock(host, t, timeout);
-			else
+			if (direction == DMA_TO_DEVICE) {
+				unsigned int next_len = 0;
+
+				if (multiple && pipeline)
+					next_len = min(length - t->len, blk_size);
+				status = mmc_spi_writeblock(host, t, timeout,
+							    next_len);
+			} else
 				status = mmc_spi_readblock(host, t, timeout);
 			if (status < 0)
 				break;
@@ -1053,6 +1430,11 @@ static void mmc_spi_request(struct mmc_host *mmc, struct mmc_request *mrq)
 	}
 #endif
 
+	/* a new request gets to try the streamed read path again, unless
+	 * it keeps failing on this card
+	 */
+	host->pipe_fallback = host->pipe_errors >= MMC_SPI_PIPE_MAX_ERRORS;
+
 	/* request exclusive bus access */
 	spi_bus_lock(host->spi->master);
 
@@ -1407,6 +1789,15 @@ static int mmc_spi_probe(struct spi_device *spi)
 	if (!host->data)
 		goto fail_nobuf1;
 
+	/* buffers for streamed reads; the SPI core maps these */
+	host->pipe_buf[0] = kmalloc(MMC_SPI_PIPE_BUFSIZE, GFP_KERNEL);
+	host->pipe_buf[1] = kmalloc(MMC_SPI_PIPE_BUFSIZE, GFP_KERNEL);
+	host->pipe_blk = kmalloc(MMC_SPI_BLOCKSIZE + 2, GFP_KERNEL);
+	if (!host->pipe_buf[0] || !host->pipe_buf[1] || !host->pipe_blk)
+		goto fail_dma;
+	init_completion(&host->pipe_done[0]);
+	init_completion(&host->pipe_done[1]);
+
 	status = mmc_spi_dma_alloc(host);
 	if (status)
 		goto fail_dma;
@@ -1479,6 +1870,9 @@ fail_add_host:
 fail_glue_init:
 	mmc_spi_dma_free(host);
 fail_dma:
+	kfree(host->pipe_blk);
+	kfree(host->pipe_buf[1]);
+	kfree(host->pipe_buf[0]);
 	kfree(host->data);
 fail_nobuf1:
 	mmc_spi_put_pdata(spi);
@@ -1501,6 +1895,9 @@ static void mmc_spi_remove(struct spi_device *spi)
 	mmc_remove_host(mmc);
 
 	mmc_spi_dma_free(host);
+	kfree(host->pipe_blk);
+	kfree(host->pipe_buf[1]);
+	kfree(host->pipe_buf[0]);
 	kfree(host->data);
 	kfree(host->ones);
 
@@ -1531,7 +1928,22 @@ static struct spi_driver mmc_spi_driver = {
 	.remove =	mmc_spi_remove,
 };
 
-module_spi_driver(mmc_spi_driver);
+#if defined(CONFIG_MMC_SPI_KUNIT_TEST)
+#include "mmc_spi-test.c"
+#endif
+
+static int __init mmc_spi_init(void)
+{
+	mmc_spi_crc16_init();
+	return spi_register_driver(&mmc_spi_driver);
+}
+module_init(mmc_spi_init);
+
+static void __exit mmc_spi_exit(void)
+{
+	spi_unregister_driver(&mmc_spi_driver);
+}
+module_exit(mmc_spi_exit);
 
 MODULE_AUTHOR("Mike Lavender, David Brownell, Hans-Peter Nilsson, Jan Nikitenko");
 MODULE_DESCRIPTION("SPI SD/MMC host driver");
@@ -1123,8 +1123,9 @@ int renesas_sdhi_probe(struct platform_device *pdev,
 			goto eirq;
 		}
 
-		ret = devm_request_irq(&pdev->dev, irq, tmio_mmc_irq, 0,
-				       dev_name(&pdev->dev), host);
+		ret = devm_request_threaded_irq(&pdev->dev, irq, tmio_mmc_irq,
+						tmio_mmc_irq_thread, 0,
+						dev_name(&pdev->dev), host);
 		if (ret)
 			goto eirq;
 	}
@@ -312,13 +312,10 @@ static void renesas_sdhi_sys_dmac_start_dma(struct tmio_mmc_host *host,
 	}
 }
 
-static void renesas_sdhi_sys_dmac_issue_tasklet_fn(unsigned long priv)
+static void renesas_sdhi_sys_dmac_issue_dma(struct tmio_mmc_host *host)
 {
-	struct tmio_mmc_host *host = (struct tmio_mmc_host *)priv;
 	struct dma_chan *chan = NULL;
 
-	spin_lock_irq(&host->lock);
-
 	if (host->data) {
 		if (host->data->flags & MMC_DATA_READ)
 			chan = host->chan_rx;
@@ -326,8 +323,6 @@ static void renesas_sdhi_sys_dmac_issue_tasklet_fn(unsigned long priv)
 			chan = host->chan_tx;
 	}
 
-	spin_unlock_irq(&host->lock);
-
 	tmio_mmc_enable_mmc_irqs(host, TMIO_STAT_DATAEND);
 
 	if (chan)
@@ -401,9 +396,6 @@ static void renesas_sdhi_sys_dmac_request_dma(struct tmio_mmc_host *host,
 			goto ebouncebuf;
 
 		init_completion(&priv->dma_priv.dma_dataend);
-		tasklet_init(&host->dma_issue,
-			     renesas_sdhi_sys_dmac_issue_tasklet_fn,
-			     (unsigned long)host);
 	}
 
 	renesas_sdhi_sys_dmac_enable_dma(host, true);
@@ -447,6 +439,7 @@ static const struct tmio_mmc_dma_ops renesas_sdhi_sys_dmac_dma_ops = {
 	.release = renesas_sdhi_sys_dmac_release_dma,
 	.abort = renesas_sdhi_sys_dmac_abort_dma,
 	.dataend = renesas_sdhi_sys_dmac_dataend_dma,
+	.issue = renesas_sdhi_sys_dmac_issue_dma,
 };
 
 static int renesas_sdhi_sys_dmac_probe(struct platform_device *pdev)
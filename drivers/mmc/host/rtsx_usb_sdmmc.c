@@ -21,12 +21,14 @@
 #include <linux/pm_runtime.h>
 
 #include <linux/rtsx_usb.h>
+#include <linux/workqueue.h>
 #include <asm/unaligned.h>
 
+#include "mmc_hsq.h"
+
 #if defined(CONFIG_LEDS_CLASS) || (defined(CONFIG_LEDS_CLASS_MODULE) && \
 		defined(CONFIG_MMC_REALTEK_USB_MODULE))
 #include <linux/leds.h>
-#include <linux/workqueue.h>
 #define RTSX_USB_USE_LEDS_CLASS
 #endif
 
@@ -35,6 +37,8 @@ struct rtsx_usb_sdmmc {
 	struct rtsx_ucr	*ucr;
 	struct mmc_host		*mmc;
 	struct mmc_request	*mrq;
+	struct work_struct	req_work;
+	struct mmc_hsq		hsq;
 
 	struct mutex		host_mutex;
 
@@ -802,16 +806,39 @@ no_card:
 	return 0;
 }
 
-static void sdmmc_request(struct mmc_host *mmc, struct mmc_request *mrq)
+static void sdmmc_request_done(struct mmc_host *mmc, struct mmc_request *mrq)
 {
-	struct rtsx_usb_sdmmc *host = mmc_priv(mmc);
+	/* Hands the next queued request to sdmmc_request() right away */
+	if (mmc_hsq_finalize_request(mmc, mrq))
+		return;
+
+	mmc_request_done(mmc, mrq);
+}
+
+static void sdmmc_request_work(struct work_struct *work)
+{
+	struct rtsx_usb_sdmmc *host =
+		container_of(work, struct rtsx_usb_sdmmc, req_work);
+	struct mmc_host *mmc = host->mmc;
 	struct rtsx_ucr *ucr = host->ucr;
-	struct mmc_command *cmd = mrq->cmd;
-	struct mmc_data *data = mrq->data;
+	struct mmc_request *mrq;
+	struct mmc_command *cmd;
+	struct mmc_data *data;
 	unsigned int data_size = 0;
 
 	dev_dbg(sdmmc_dev(host), "%s\n", __func__);
 
+	mutex_lock(&host->host_mutex);
+	mrq = host->mrq;
+	mutex_unlock(&host->host_mutex);
+
+	/* Already failed by the remove path */
+	if (!mrq)
+		return;
+
+	cmd = mrq->cmd;
+	data = mrq->data;
+
 	if (host->host_removal) {
 		cmd->error = -ENOMEDIUM;
 		goto finish;
@@ -824,10 +851,6 @@ static void sdmmc_request(struct mmc_host *mmc, struct mmc_request *mrq)
 
 	mutex_lock(&ucr->dev_mutex);
 
-	mutex_lock(&host->host_mutex);
-	host->mrq = mrq;
-	mutex_unlock(&host->host_mutex);
-
 	if (mrq->data)
 		data_size = data->blocks * data->blksz;
 
@@ -874,7 +897,22 @@ finish:
 	host->mrq = NULL;
 	mutex_unlock(&host->host_mutex);
 
-	mmc_request_done(mmc, mrq);
+	sdmmc_request_done(mmc, mrq);
+}
+
+/*
+ * The transfer runs from a work item, so the block layer can prepare and
+ * queue the next request while this one is still on the USB bus.
+ */
+static void sdmmc_request(struct mmc_host *mmc, struct mmc_request *mrq)
+{
+	struct rtsx_usb_sdmmc *host = mmc_priv(mmc);
+
+	mutex_lock(&host->host_mutex);
+	host->mrq = mrq;
+	mutex_unlock(&host->host_mutex);
+
+	schedule_work(&host->req_work);
 }
 
 static int sd_set_bus_width(struct rtsx_usb_sdmmc *host,
@@ -1326,9 +1364,7 @@ static int rtsx_usb_sdmmc_drv_probe(struct platform_device *pdev)
 	struct mmc_host *mmc;
 	struct rtsx_usb_sdmmc *host;
 	struct rtsx_ucr *ucr;
-#ifdef RTSX_USB_USE_LEDS_CLASS
 	int err;
-#endif
 
 	ucr = usb_get_intfdata(to_usb_interface(pdev->dev.parent));
 	if (!ucr)
@@ -1347,7 +1383,15 @@ static int rtsx_usb_sdmmc_drv_probe(struct platform_device *pdev)
 	platform_set_drvdata(pdev, host);
 
 	mutex_init(&host->host_mutex);
+	INIT_WORK(&host->req_work, sdmmc_request_work);
 	rtsx_usb_init_host(host);
+
+	err = mmc_hsq_init(&host->hsq, mmc);
+	if (err) {
+		mmc_free_host(mmc);
+		return err;
+	}
+
 	pm_runtime_enable(&pdev->dev);
 
 #ifdef RTSX_USB_USE_LEDS_CLASS
@@ -1373,6 +1417,7 @@ static int rtsx_usb_sdmmc_drv_probe(struct platform_device *pdev)
 static int rtsx_usb_sdmmc_drv_remove(struct platform_device *pdev)
 {
 	struct rtsx_usb_sdmmc *host = platform_get_drvdata(pdev);
+	struct mmc_request *mrq;
 	struct mmc_host *mmc;
 
 	if (!host)
@@ -1380,20 +1425,27 @@ static int rtsx_usb_sdmmc_drv_remove(struct platform_device *pdev)
 
 	mmc = host->mmc;
 	host->host_removal = true;
+	cancel_work_sync(&host->req_work);
 
 	mutex_lock(&host->host_mutex);
-	if (host->mrq) {
+	mrq = host->mrq;
+	host->mrq = NULL;
+	mutex_unlock(&host->host_mutex);
+
+	/* Outside host_mutex: completing may hand us the next request */
+	if (mrq) {
 		dev_dbg(&(pdev->dev),
 			"%s: Controller removed during transfer\n",
 			mmc_hostname(mmc));
-		host->mrq->cmd->error = -ENOMEDIUM;
-		if (host->mrq->stop)
-			host->mrq->stop->error = -ENOMEDIUM;
-		mmc_request_done(mmc, host->mrq);
+		mrq->cmd->error = -ENOMEDIUM;
+		if (mrq->stop)
+			mrq->stop->error = -ENOMEDIUM;
+		sdmmc_request_done(mmc, mrq);
 	}
-	mutex_unlock(&host->host_mutex);
 
 	mmc_remove_host(mmc);
+	/* Completing mrq above may have scheduled the next queued request */
+	cancel_work_sync(&host->req_work);
 
 #ifdef RTSX_USB_USE_LEDS_CLASS
 	cancel_work_sync(&host->led_work);
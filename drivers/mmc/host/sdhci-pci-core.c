@@ -176,7 +176,7 @@ err_pci_runtime_suspend:
 	return ret;
 }
 
-static int sdhci_pci_runtime_resume_host(struct sdhci_pci_chip *chip)
+int sdhci_pci_runtime_resume_host(struct sdhci_pci_chip *chip)
 {
 	struct sdhci_pci_slot *slot;
 	int i, ret;
@@ -1993,31 +1993,100 @@ static int sdhci_pci_resume(struct device *dev)
 }
 #endif
 
+#define SDHCI_PCI_RPM_DELAY_MIN		50
+#define SDHCI_PCI_RPM_DELAY_MAX		2000
+#define SDHCI_PCI_RPM_DECAY_FACTOR	8
+
+static void sdhci_pci_rpm_delay_work(struct work_struct *work)
+{
+	struct sdhci_pci_chip *chip = container_of(work, struct sdhci_pci_chip,
+						   rpm_delay_work);
+	struct device *dev = &chip->pdev->dev;
+	u32 delay = READ_ONCE(chip->rpm_delay);
+
 #ifdef CONFIG_PM
+	/* User space has set its own delay through sysfs */
+	if (READ_ONCE(dev->power.autosuspend_delay) != chip->rpm_delay_applied) {
+		chip->rpm_adaptive = false;
+		return;
+	}
+#endif
+
+	pm_runtime_set_autosuspend_delay(dev, delay);
+	chip->rpm_delay_applied = delay;
+}
+
+#ifdef CONFIG_PM
+/*
+ * Bursty I/O makes a fixed autosuspend delay suspend between bursts, and
+ * every resume pays for re-initializing the controller (and on some parts
+ * its PLL). A suspend that lasted less than the autosuspend delay did not pay
+ * for its resume, so the delay is doubled. One that lasted much longer lets
+ * the delay decay back towards the default. If user space sets the delay
+ * through sysfs, adapting stops.
+ */
+static void sdhci_pci_rpm_adapt(struct sdhci_pci_chip *chip, ktime_t now)
+{
+	u32 delay = chip->rpm_delay;
+	s64 gap_ms;
+
+	if (!chip->rpm_adaptive || !chip->rpm_suspended_at)
+		return;
+
+	gap_ms = ktime_ms_delta(now, chip->rpm_suspended_at);
+	if (gap_ms < delay)
+		delay = min_t(u32, delay * 2, SDHCI_PCI_RPM_DELAY_MAX);
+	else if (gap_ms > (s64)delay * SDHCI_PCI_RPM_DECAY_FACTOR)
+		delay = max_t(u32, delay / 2, SDHCI_PCI_RPM_DELAY_MIN);
+
+	if (delay == chip->rpm_delay)
+		return;
+
+	/* Cannot change the delay from within a runtime PM callback */
+	WRITE_ONCE(chip->rpm_delay, delay);
+	schedule_work(&chip->rpm_delay_work);
+}
+
 static int sdhci_pci_runtime_suspend(struct device *dev)
 {
 	struct sdhci_pci_chip *chip = dev_get_drvdata(dev);
+	int ret;
 
 	if (!chip)
 		return 0;
 
 	if (chip->fixes && chip->fixes->runtime_suspend)
-		return chip->fixes->runtime_suspend(chip);
+		ret = chip->fixes->runtime_suspend(chip);
+	else
+		ret = sdhci_pci_runtime_suspend_host(chip);
 
-	return sdhci_pci_runtime_suspend_host(chip);
+	if (!ret)
+		chip->rpm_suspended_at = ktime_get();
+
+	return ret;
 }
 
 static int sdhci_pci_runtime_resume(struct device *dev)
 {
 	struct sdhci_pci_chip *chip = dev_get_drvdata(dev);
+	ktime_t start;
+	int ret;
 
 	if (!chip)
 		return 0;
 
+	start = ktime_get();
+	sdhci_pci_rpm_adapt(chip, start);
+
 	if (chip->fixes && chip->fixes->runtime_resume)
-		return chip->fixes->runtime_resume(chip);
+		ret = chip->fixes->runtime_resume(chip);
+	else
+		ret = sdhci_pci_runtime_resume_host(chip);
 
-	return sdhci_pci_runtime_resume_host(chip);
+	chip->rpm_resume_count += 1;
+	chip->rpm_resume_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	return ret;
 }
 #endif
 
@@ -2181,20 +2250,50 @@ void sdhci_pci_uhs2_remove_host(struct sdhci_pci_slot *slot, int dead)
 	sdhci_uhs2_remove_host(slot->host, dead);
 }
 
-static void sdhci_pci_runtime_pm_allow(struct device *dev)
+static void sdhci_pci_rpm_add_debugfs(struct sdhci_pci_chip *chip)
+{
+	int i;
+
+	for (i = 0; i < chip->num_slots; i++) {
+		struct dentry *dir = chip->slots[i]->host->mmc->debugfs_root;
+
+		if (!dir)
+			continue;
+
+		debugfs_create_u32("rpm_autosuspend_delay", 0444, dir,
+				   &chip->rpm_delay);
+		debugfs_create_u64("rpm_resume_count", 0444, dir,
+				   &chip->rpm_resume_count);
+		debugfs_create_u64("rpm_resume_ns", 0444, dir,
+				   &chip->rpm_resume_ns);
+	}
+}
+
+static void sdhci_pci_runtime_pm_allow(struct sdhci_pci_chip *chip)
 {
+	struct device *dev = &chip->pdev->dev;
+
+	chip->rpm_delay = SDHCI_PCI_RPM_DELAY_MIN;
+	chip->rpm_delay_applied = chip->rpm_delay;
+	chip->rpm_adaptive = true;
+	INIT_WORK(&chip->rpm_delay_work, sdhci_pci_rpm_delay_work);
+	sdhci_pci_rpm_add_debugfs(chip);
+
 	pm_suspend_ignore_children(dev, 1);
-	pm_runtime_set_autosuspend_delay(dev, 50);
+	pm_runtime_set_autosuspend_delay(dev, chip->rpm_delay);
 	pm_runtime_use_autosuspend(dev);
 	pm_runtime_allow(dev);
 	/* Stay active until mmc core scans for a card */
 	pm_runtime_put_noidle(dev);
 }
 
-static void sdhci_pci_runtime_pm_forbid(struct device *dev)
+static void sdhci_pci_runtime_pm_forbid(struct sdhci_pci_chip *chip)
 {
+	struct device *dev = &chip->pdev->dev;
+
 	pm_runtime_forbid(dev);
 	pm_runtime_get_noresume(dev);
+	cancel_work_sync(&chip->rpm_delay_work);
 }
 
 static int sdhci_pci_probe(struct pci_dev *pdev,
@@ -2273,7 +2372,7 @@ static int sdhci_pci_probe(struct pci_dev *pdev,
 	}
 
 	if (chip->allow_runtime_pm)
-		sdhci_pci_runtime_pm_allow(&pdev->dev);
+		sdhci_pci_runtime_pm_allow(chip);
 
 	return 0;
 }
@@ -2284,7 +2383,7 @@ static void sdhci_pci_remove(struct pci_dev *pdev)
 	struct sdhci_pci_chip *chip = pci_get_drvdata(pdev);
 
 	if (chip->allow_runtime_pm)
-		sdhci_pci_runtime_pm_forbid(&pdev->dev);
+		sdhci_pci_runtime_pm_forbid(chip);
 
 	for (i = 0; i < chip->num_slots; i++)
 		sdhci_pci_remove_slot(chip->slots[i]);
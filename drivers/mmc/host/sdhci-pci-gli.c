@@ -178,6 +178,12 @@
 
 #define GLI_MAX_TUNING_LOOP 40
 
+struct gl9755_host {
+	/* PLL/SSC setting last programmed by sdhci_gl9755_set_clock() */
+	bool pll_valid;
+	unsigned int pll_clock;		/* 0 when the PLL is off */
+};
+
 /* Genesys Logic chipset */
 static inline void gl9750_wt_on(struct sdhci_host *host)
 {
@@ -649,30 +655,54 @@ static void gl9755_set_ssc_pll_50mhz(struct pci_dev *pdev)
 	gl9755_set_pll(pdev, 0x1, 0x244, 0x3);
 }
 
+/*
+ * Re-tuning, resume and many set_ios() calls set the same clock
+ * again. Leave the PLL and SSC alone when they are already programmed for
+ * the requested clock, which saves a dozen PCI config accesses and the 1ms
+ * PLL lock wait.
+ */
 static void sdhci_gl9755_set_clock(struct sdhci_host *host, unsigned int clock)
 {
 	struct sdhci_pci_slot *slot = sdhci_priv(host);
+	struct gl9755_host *gl_host = sdhci_pci_priv(slot);
 	struct mmc_ios *ios = &host->mmc->ios;
+	unsigned int pll_clock = 0;
 	struct pci_dev *pdev;
+	bool pll_changed;
 	u16 clk;
 
 	pdev = slot->chip->pdev;
 	host->mmc->actual_clock = 0;
 
-	gl9755_disable_ssc_pll(pdev);
+	if (clock == 200000000 && ios->timing == MMC_TIMING_UHS_SDR104)
+		pll_clock = 205000000;
+	else if (clock == 100000000 || clock == 50000000)
+		pll_clock = clock;
+
+	pll_changed = !gl_host->pll_valid || gl_host->pll_clock != pll_clock;
+
+	if (pll_changed) {
+		gl9755_disable_ssc_pll(pdev);
+		gl_host->pll_clock = 0;
+		gl_host->pll_valid = true;
+	}
 	sdhci_writew(host, 0, SDHCI_CLOCK_CONTROL);
 
 	if (clock == 0)
 		return;
 
 	clk = sdhci_calc_clk(host, clock, &host->mmc->actual_clock);
-	if (clock == 200000000 && ios->timing == MMC_TIMING_UHS_SDR104) {
+	if (pll_clock == 205000000)
 		host->mmc->actual_clock = 205000000;
-		gl9755_set_ssc_pll_205mhz(pdev);
-	} else if (clock == 100000000) {
-		gl9755_set_ssc_pll_100mhz(pdev);
-	} else if (clock == 50000000) {
-		gl9755_set_ssc_pll_50mhz(pdev);
+
+	if (pll_changed) {
+		if (pll_clock == 205000000)
+			gl9755_set_ssc_pll_205mhz(pdev);
+		else if (pll_clock == 100000000)
+			gl9755_set_ssc_pll_100mhz(pdev);
+		else if (pll_clock == 50000000)
+			gl9755_set_ssc_pll_50mhz(pdev);
+		gl_host->pll_clock = pll_clock;
 	}
 
 	sdhci_enable_clk(host, clk);
@@ -1066,6 +1096,16 @@ static int sdhci_pci_gli_resume(struct sdhci_pci_chip *chip)
 	return sdhci_pci_resume_host(chip);
 }
 
+static int sdhci_pci_gl9755_resume(struct sdhci_pci_chip *chip)
+{
+	struct gl9755_host *gl_host = sdhci_pci_priv(chip->slots[0]);
+
+	/* Vendor config registers may have been lost in D3 */
+	gl_host->pll_valid = false;
+
+	return sdhci_pci_gli_resume(chip);
+}
+
 static int sdhci_cqhci_gli_resume(struct sdhci_pci_chip *chip)
 {
 	struct sdhci_pci_slot *slot = chip->slots[0];
@@ -1290,6 +1330,16 @@ static void gl9763e_set_low_power_negotiation(struct sdhci_pci_slot *slot, bool
 	pci_write_config_dword(pdev, PCIE_GLI_9763E_VHS, value);
 }
 
+static int gl9755_runtime_resume(struct sdhci_pci_chip *chip)
+{
+	struct gl9755_host *gl_host = sdhci_pci_priv(chip->slots[0]);
+
+	/* Vendor config registers may have been lost in D3 */
+	gl_host->pll_valid = false;
+
+	return sdhci_pci_runtime_resume_host(chip);
+}
+
 static int gl9763e_runtime_suspend(struct sdhci_pci_chip *chip)
 {
 	struct sdhci_pci_slot *slot = chip->slots[0];
@@ -1412,8 +1462,12 @@ const struct sdhci_pci_fixes sdhci_gl9755 = {
 	.add_host	= sdhci_pci_uhs2_add_host,
 	.remove_host	= sdhci_pci_uhs2_remove_host,
 	.ops            = &sdhci_gl9755_ops,
+	.priv_size	= sizeof(struct gl9755_host),
 #ifdef CONFIG_PM_SLEEP
-	.resume         = sdhci_pci_gli_resume,
+	.resume         = sdhci_pci_gl9755_resume,
+#endif
+#ifdef CONFIG_PM
+	.runtime_resume = gl9755_runtime_resume,
 #endif
 };
 
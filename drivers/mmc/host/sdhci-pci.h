@@ -178,6 +178,15 @@ struct sdhci_pci_chip {
 
 	int			num_slots;	/* Slots on controller */
 	struct sdhci_pci_slot	*slots[MAX_SLOTS]; /* Pointers to host slots */
+
+	/* Adaptive autosuspend, see sdhci_pci_rpm_adapt() */
+	bool			rpm_adaptive;
+	u32			rpm_delay;	/* Autosuspend delay (ms) */
+	u32			rpm_delay_applied;
+	ktime_t			rpm_suspended_at;
+	struct work_struct	rpm_delay_work;
+	u64			rpm_resume_count;
+	u64			rpm_resume_ns;	/* Total runtime resume time */
 };
 
 static inline void *sdhci_pci_priv(struct sdhci_pci_slot *slot)
@@ -190,6 +199,9 @@ void sdhci_pci_uhs2_remove_host(struct sdhci_pci_slot *slot, int dead);
 #ifdef CONFIG_PM_SLEEP
 int sdhci_pci_resume_host(struct sdhci_pci_chip *chip);
 #endif
+#ifdef CONFIG_PM
+int sdhci_pci_runtime_resume_host(struct sdhci_pci_chip *chip);
+#endif
 int sdhci_pci_enable_dma(struct sdhci_host *host);
 
 extern const struct sdhci_pci_fixes sdhci_arasan;
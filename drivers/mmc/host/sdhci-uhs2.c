@@ -10,6 +10,7 @@
  *  Author: AKASHI Takahiro <takahiro.akashi@linaro.org>
  */
 
+#include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/dmaengine.h>
 #include <linux/ktime.h>
@@ -83,6 +84,9 @@ void sdhci_uhs2_reset(struct sdhci_host *host, u16 mask)
 	unsigned long timeout;
 	u32 val;
 
+	host->uhs2_cmd_pkt_valid = false;
+	host->uhs2_trans_mode_valid = false;
+
 	if (!(sdhci_uhs2_mode(host))) {
 		/**
 		 * u8  mask for legacy.
@@ -605,6 +609,19 @@ static void sdhci_uhs2_finish_data(struct sdhci_host *host)
 	__sdhci_finish_mrq(host, data->mrq);
 }
 
+static void sdhci_uhs2_write_trans_mode(struct sdhci_host *host, u16 mode)
+{
+	if (host->uhs2_trans_mode_valid && host->uhs2_trans_mode == mode) {
+		host->uhs2_mmio_skipped += 1;
+		return;
+	}
+
+	sdhci_writew(host, mode, SDHCI_UHS2_TRANS_MODE);
+	host->uhs2_trans_mode = mode;
+	host->uhs2_trans_mode_valid = true;
+	host->uhs2_mmio_writes += 1;
+}
+
 static void sdhci_uhs2_set_transfer_mode(struct sdhci_host *host,
 					 struct mmc_command *cmd)
 {
@@ -619,7 +636,10 @@ static void sdhci_uhs2_set_transfer_mode(struct sdhci_host *host,
 		       UHS2_DEV_CMD_TRANS_ABORT) {
 			mode =  0;
 		} else {
-			mode = sdhci_readw(host, SDHCI_UHS2_TRANS_MODE);
+			if (host->uhs2_trans_mode_valid)
+				mode = host->uhs2_trans_mode;
+			else
+				mode = sdhci_readw(host, SDHCI_UHS2_TRANS_MODE);
 			if (cmd->opcode == MMC_STOP_TRANSMISSION ||
 			    cmd->opcode == MMC_ERASE)
 				mode |= SDHCI_UHS2_TRNS_WAIT_EBSY;
@@ -632,7 +652,7 @@ static void sdhci_uhs2_set_transfer_mode(struct sdhci_host *host,
 		if (IS_ENABLED(CONFIG_MMC_DEBUG))
 			DBG("UHS2 no data trans mode is 0x%x.\n", mode);
 
-		sdhci_writew(host, mode, SDHCI_UHS2_TRANS_MODE);
+		sdhci_uhs2_write_trans_mode(host, mode);
 		return;
 	}
 
@@ -656,12 +676,32 @@ static void sdhci_uhs2_set_transfer_mode(struct sdhci_host *host,
 	if ((host->mmc->uhs2_ios.is_2L_HD_mode) && !cmd->uhs2_tmode0_flag)
 		mode |= SDHCI_UHS2_TRNS_2L_HD;
 
-	sdhci_writew(host, mode, SDHCI_UHS2_TRANS_MODE);
+	sdhci_uhs2_write_trans_mode(host, mode);
 
 	if (IS_ENABLED(CONFIG_MMC_DEBUG))
 		DBG("UHS2 trans mode is 0x%x.\n", mode);
 }
 
+/*
+ * The command packet registers keep their contents between commands, and
+ * most commands differ from the previous one in a dword or two only, so
+ * only write the dwords that changed.
+ */
+static void sdhci_uhs2_write_cmd_pkt(struct sdhci_host *host, int offset,
+				     u32 val)
+{
+	u32 *pkt = &host->uhs2_cmd_pkt[offset / 4];
+
+	if (host->uhs2_cmd_pkt_valid && *pkt == val) {
+		host->uhs2_mmio_skipped += 1;
+		return;
+	}
+
+	sdhci_writel(host, val, SDHCI_UHS2_CMD_PACKET + offset);
+	*pkt = val;
+	host->uhs2_mmio_writes += 1;
+}
+
 static void __sdhci_uhs2_send_command(struct sdhci_host *host,
 				      struct mmc_command *cmd)
 {
@@ -676,11 +716,12 @@ static void __sdhci_uhs2_send_command(struct sdhci_host *host,
 		}
 	}
 
+	BUILD_BUG_ON(sizeof(host->uhs2_cmd_pkt) != SDHCI_UHS2_CMD_PACK_MAX_LEN);
+
 	i = 0;
-	sdhci_writel(host,
-		     ((u32)cmd->uhs2_cmd->arg << 16) |
-				(u32)cmd->uhs2_cmd->header,
-		     SDHCI_UHS2_CMD_PACKET + i);
+	sdhci_uhs2_write_cmd_pkt(host, i,
+				 ((u32)cmd->uhs2_cmd->arg << 16) |
+				 (u32)cmd->uhs2_cmd->header);
 	i += 4;
 
 	/*
@@ -689,13 +730,14 @@ static void __sdhci_uhs2_send_command(struct sdhci_host *host,
 	 * MSB when preparing config read/write commands.
 	 */
 	for (j = 0; j < cmd->uhs2_cmd->payload_len / sizeof(u32); j++) {
-		sdhci_writel(host, *(cmd->uhs2_cmd->payload + j),
-			     SDHCI_UHS2_CMD_PACKET + i);
+		sdhci_uhs2_write_cmd_pkt(host, i, *(cmd->uhs2_cmd->payload + j));
 		i += 4;
 	}
 
 	for ( ; i < SDHCI_UHS2_CMD_PACK_MAX_LEN; i += 4)
-		sdhci_writel(host, 0, SDHCI_UHS2_CMD_PACKET + i);
+		sdhci_uhs2_write_cmd_pkt(host, i, 0);
+
+	host->uhs2_cmd_pkt_valid = true;
 
 	if (IS_ENABLED(CONFIG_MMC_DEBUG)) {
 		DBG("UHS2 CMD packet_len = %d.\n", cmd->uhs2_cmd->packet_len);
@@ -1233,6 +1275,19 @@ static int __sdhci_uhs2_add_host_v4(struct sdhci_host *host, u32 caps1)
 
 static int sdhci_uhs2_host_ops_init(struct sdhci_host *host);
 
+static void sdhci_uhs2_debugfs_init(struct sdhci_host *host)
+{
+	struct dentry *dir = host->mmc->debugfs_root;
+
+	if (!dir)
+		return;
+
+	debugfs_create_u64("uhs2_mmio_writes", 0400, dir,
+			   &host->uhs2_mmio_writes);
+	debugfs_create_u64("uhs2_mmio_skipped", 0400, dir,
+			   &host->uhs2_mmio_skipped);
+}
+
 static int __sdhci_uhs2_add_host(struct sdhci_host *host)
 {
 	unsigned int flags = WQ_UNBOUND | WQ_MEM_RECLAIM | WQ_HIGHPRI;
@@ -1284,6 +1339,9 @@ static int __sdhci_uhs2_add_host(struct sdhci_host *host)
 
 	sdhci_enable_card_detection(host);
 
+	if (mmc->caps2 & MMC_CAP2_SD_UHS2)
+		sdhci_uhs2_debugfs_init(host);
+
 	return 0;
 
 unwq:
@@ -1363,7 +1421,7 @@ void sdhci_uhs2_request(struct mmc_host *mmc, struct mmc_request *mrq)
 	}
 
 	/* Firstly check card presence */
-	present = mmc->ops->get_cd(mmc);
+	present = sdhci_card_present(host);
 
 	spin_lock_irqsave(&host->lock, flags);
 
@@ -259,6 +259,10 @@ static bool sdhci_do_reset(struct sdhci_host *host, u8 mask)
 
 	host->ops->reset(host, mask);
 
+	/* A reset may clear the UHS-II command registers */
+	host->uhs2_cmd_pkt_valid = false;
+	host->uhs2_trans_mode_valid = false;
+
 	return true;
 }
 
@@ -515,22 +519,41 @@ static inline void sdhci_led_deactivate(struct sdhci_host *host)
 
 #endif
 
+/*
+ * Request timers are armed lazily. A command only records its deadline, and
+ * the timer is touched only when it is not pending or would fire too late.
+ * Completion leaves the timer alone. A timer that fires before the deadline
+ * of the request in flight re-arms itself, see sdhci_timer_early(). This
+ * keeps timer wheel operations off the per-request path.
+ */
+static void sdhci_arm_timer(struct timer_list *timer, unsigned long *deadline,
+			    unsigned long timeout)
+{
+	*deadline = timeout;
+
+	if (!timer_pending(timer) || time_after(timer->expires, timeout))
+		mod_timer(timer, timeout);
+}
+
 void sdhci_mod_timer(struct sdhci_host *host, struct mmc_request *mrq,
 		     unsigned long timeout)
 {
 	if (sdhci_data_line_cmd(mrq->cmd))
-		mod_timer(&host->data_timer, timeout);
+		sdhci_arm_timer(&host->data_timer, &host->data_timer_deadline,
+				timeout);
 	else
-		mod_timer(&host->timer, timeout);
+		sdhci_arm_timer(&host->timer, &host->timer_deadline, timeout);
 }
 EXPORT_SYMBOL_GPL(sdhci_mod_timer);
 
-static void sdhci_del_timer(struct sdhci_host *host, struct mmc_request *mrq)
+static bool sdhci_timer_early(struct timer_list *timer, unsigned long deadline)
 {
-	if (sdhci_data_line_cmd(mrq->cmd))
-		del_timer(&host->data_timer);
-	else
-		del_timer(&host->timer);
+	if (!time_before(jiffies, deadline))
+		return false;
+
+	mod_timer(timer, deadline);
+
+	return true;
 }
 
 static inline bool sdhci_has_requests(struct sdhci_host *host)
@@ -1578,8 +1601,6 @@ void __sdhci_finish_mrq(struct sdhci_host *host, struct mmc_request *mrq)
 
 	sdhci_set_mrq_done(host, mrq);
 
-	sdhci_del_timer(host, mrq);
-
 	if (!sdhci_has_requests(host))
 		sdhci_led_deactivate(host);
 }
@@ -2247,7 +2268,7 @@ void sdhci_request(struct mmc_host *mmc, struct mmc_request *mrq)
 	bool present;
 
 	/* Firstly check card presence */
-	present = mmc->ops->get_cd(mmc);
+	present = sdhci_card_present(host);
 
 	spin_lock_irqsave(&host->lock, flags);
 
@@ -2533,6 +2554,33 @@ static int sdhci_get_cd(struct mmc_host *mmc)
 	return !!(sdhci_readl(host, SDHCI_PRESENT_STATE) & SDHCI_CARD_PRESENT);
 }
 
+/*
+ * Card presence as seen by the request path. With interrupt driven card
+ * detection, the result of sdhci_get_cd() only changes after a card detect
+ * event, so it is cached and re-read once mmc->cd_gen moves on. That saves a
+ * GPIO or register read per request. Polled detection and drivers with their
+ * own ->get_cd() are always asked.
+ */
+bool sdhci_card_present(struct sdhci_host *host)
+{
+	struct mmc_host *mmc = host->mmc;
+	unsigned int gen = READ_ONCE(mmc->cd_gen);
+
+	if ((mmc->caps & MMC_CAP_NEEDS_POLL) ||
+	    host->mmc_host_ops.get_cd != sdhci_get_cd)
+		return mmc->ops->get_cd(mmc);
+
+	if (host->cd_valid && host->cd_gen == gen)
+		return host->cd_present;
+
+	host->cd_present = mmc->ops->get_cd(mmc);
+	host->cd_gen = gen;
+	host->cd_valid = true;
+
+	return host->cd_present;
+}
+EXPORT_SYMBOL_GPL(sdhci_card_present);
+
 int sdhci_get_cd_nogpio(struct mmc_host *mmc)
 {
 	struct sdhci_host *host = mmc_priv(mmc);
@@ -2867,8 +2915,6 @@ void sdhci_send_tuning(struct sdhci_host *host, u32 opcode)
 
 	host->cmd = NULL;
 
-	sdhci_del_timer(host, &mrq);
-
 	host->tuning_done = 0;
 
 	spin_unlock_irqrestore(&host->lock, flags);
@@ -3257,7 +3303,8 @@ void sdhci_timeout_timer(struct timer_list *t)
 
 	spin_lock_irqsave(&host->lock, flags);
 
-	if (host->cmd && !sdhci_data_line_cmd(host->cmd)) {
+	if (host->cmd && !sdhci_data_line_cmd(host->cmd) &&
+	    !sdhci_timer_early(&host->timer, host->timer_deadline)) {
 		pr_err("%s: Timeout waiting for hardware cmd interrupt.\n",
 		       mmc_hostname(host->mmc));
 		sdhci_err_stats_inc(host, REQ_TIMEOUT);
@@ -3280,8 +3327,9 @@ void sdhci_timeout_data_timer(struct timer_list *t)
 
 	spin_lock_irqsave(&host->lock, flags);
 
-	if (host->data || host->data_cmd ||
-	    (host->cmd && sdhci_data_line_cmd(host->cmd))) {
+	if ((host->data || host->data_cmd ||
+	     (host->cmd && sdhci_data_line_cmd(host->cmd))) &&
+	    !sdhci_timer_early(&host->data_timer, host->data_timer_deadline)) {
 		pr_err("%s: Timeout waiting for hardware interrupt.\n",
 		       mmc_hostname(host->mmc));
 		sdhci_err_stats_inc(host, REQ_TIMEOUT);
@@ -3835,6 +3883,9 @@ int sdhci_resume_host(struct sdhci_host *host)
 	struct mmc_host *mmc = host->mmc;
 	int ret = 0;
 
+	/* The card may have changed while card detect was not active */
+	host->cd_valid = false;
+
 	if (host->flags & (SDHCI_USE_SDMA | SDHCI_USE_ADMA)) {
 		if (host->ops->enable_dma)
 			host->ops->enable_dma(host);
@@ -3896,6 +3947,9 @@ int sdhci_runtime_resume_host(struct sdhci_host *host, int soft_reset)
 	unsigned long flags;
 	int host_flags = host->flags;
 
+	/* The card may have changed while card detect was not active */
+	host->cd_valid = false;
+
 	if (host_flags & (SDHCI_USE_SDMA | SDHCI_USE_ADMA)) {
 		if (host->ops->enable_dma)
 			host->ops->enable_dma(host);
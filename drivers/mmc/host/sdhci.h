@@ -603,6 +603,9 @@ struct sdhci_host {
 	bool v4_mode;		/* Host Version 4 Enable */
 	bool use_external_dma;	/* Host selects to use external DMA */
 	bool always_defer_done;	/* Always defer to complete requests */
+	bool cd_valid;		/* cd_present is valid for cd_gen */
+	bool cd_present;	/* Cached card presence */
+	unsigned int cd_gen;	/* mmc->cd_gen when cd_present was read */
 
 	struct mmc_request *mrqs_done[SDHCI_MAX_MRQS];	/* Requests done */
 	struct mmc_command *cmd;	/* Current command */
@@ -634,6 +637,8 @@ struct sdhci_host {
 
 	struct timer_list timer;	/* Timer for timeouts */
 	struct timer_list data_timer;	/* Timer for data timeouts */
+	unsigned long timer_deadline;	/* Current cmd timeout (jiffies) */
+	unsigned long data_timer_deadline; /* Current data timeout (jiffies) */
 
 #if IS_ENABLED(CONFIG_MMC_SDHCI_EXTERNAL_DMA)
 	struct dma_chan *rx_chan;
@@ -657,6 +662,15 @@ struct sdhci_host {
 	/* cached registers */
 	u32			ier;
 
+	/* UHS-II command packet and transfer mode as last written */
+	bool			uhs2_cmd_pkt_valid;
+	bool			uhs2_trans_mode_valid;
+	u16			uhs2_trans_mode;
+	u32			uhs2_cmd_pkt[5]; /* SDHCI_UHS2_CMD_PACK_MAX_LEN */
+	/* UHS-II command register writes issued and skipped, for debugfs */
+	u64			uhs2_mmio_writes;
+	u64			uhs2_mmio_skipped;
+
 	bool			cqe_on;		/* CQE is operating */
 	u32			cqe_ier;	/* CQE interrupt mask */
 	u32			cqe_err_ier;	/* CQE error interrupt mask */
@@ -893,6 +907,7 @@ unsigned short sdhci_get_vdd_value(unsigned short vdd);
 void sdhci_set_power_noreg(struct sdhci_host *host, unsigned char mode,
 			   unsigned short vdd);
 int sdhci_get_cd_nogpio(struct mmc_host *mmc);
+bool sdhci_card_present(struct sdhci_host *host);
 void sdhci_request(struct mmc_host *mmc, struct mmc_request *mrq);
 int sdhci_request_atomic(struct mmc_host *mmc, struct mmc_request *mrq);
 void sdhci_set_bus_width(struct sdhci_host *host, int width);
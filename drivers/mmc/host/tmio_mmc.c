@@ -168,9 +168,10 @@ static int tmio_mmc_probe(struct platform_device *pdev)
 	if (ret)
 		goto host_free;
 
-	ret = devm_request_irq(&pdev->dev, irq, tmio_mmc_irq,
-			       IRQF_TRIGGER_FALLING,
-			       dev_name(&pdev->dev), host);
+	ret = devm_request_threaded_irq(&pdev->dev, irq, tmio_mmc_irq,
+					tmio_mmc_irq_thread,
+					IRQF_TRIGGER_FALLING,
+					dev_name(&pdev->dev), host);
 	if (ret)
 		goto host_remove;
 
@@ -16,7 +16,6 @@
  * support). (Further 4 bit support from a later datasheet).
  *
  * TODO:
- *   Investigate using a workqueue for PIO transfers
  *   Eliminate FIXMEs
  *   Better Power management
  *   Handle MMC errors better
@@ -405,6 +404,9 @@ static void tmio_mmc_transfer_data(struct tmio_mmc_host *host,
  * This chip always returns (at least?) as much data as you ask for.
  * I'm unsure what happens if you ask for less than a block. This should be
  * looked into to ensure that a funny length read doesn't hose the controller.
+ *
+ * Runs from the IRQ thread, one block per RXRDY / TXRQ. Called with
+ * host->lock held, so the request can't complete or be reset underneath.
  */
 static void tmio_mmc_pio_irq(struct tmio_mmc_host *host)
 {
@@ -412,7 +414,6 @@ static void tmio_mmc_pio_irq(struct tmio_mmc_host *host)
 	void *sg_virt;
 	unsigned short *buf;
 	unsigned int count;
-	unsigned long flags;
 
 	if (host->dma_on) {
 		pr_err("PIO IRQ in DMA mode!\n");
@@ -422,8 +423,8 @@ static void tmio_mmc_pio_irq(struct tmio_mmc_host *host)
 		return;
 	}
 
-	sg_virt = tmio_mmc_kmap_atomic(host->sg_ptr, &flags);
-	buf = (unsigned short *)(sg_virt + host->sg_off);
+	sg_virt = kmap_local_page(sg_page(host->sg_ptr));
+	buf = (unsigned short *)(sg_virt + host->sg_ptr->offset + host->sg_off);
 
 	count = host->sg_ptr->length - host->sg_off;
 	if (count > data->blksz)
@@ -437,7 +438,7 @@ static void tmio_mmc_pio_irq(struct tmio_mmc_host *host)
 
 	host->sg_off += count;
 
-	tmio_mmc_kunmap_atomic(host->sg_ptr, &flags, sg_virt);
+	kunmap_local(sg_virt);
 
 	if (host->sg_off == host->sg_ptr->length)
 		tmio_mmc_next_sg(host);
@@ -607,7 +608,7 @@ static void tmio_mmc_cmd_irq(struct tmio_mmc_host *host, unsigned int stat)
 			} else {
 				tmio_mmc_disable_mmc_irqs(host,
 							  TMIO_MASK_READOP);
-				tasklet_schedule(&host->dma_issue);
+				host->dma_ops->issue(host);
 			}
 		} else {
 			if (!host->dma_on) {
@@ -615,7 +616,7 @@ static void tmio_mmc_cmd_irq(struct tmio_mmc_host *host, unsigned int stat)
 			} else {
 				tmio_mmc_disable_mmc_irqs(host,
 							  TMIO_MASK_WRITEOP);
-				tasklet_schedule(&host->dma_issue);
+				host->dma_ops->issue(host);
 			}
 		}
 	} else {
@@ -645,32 +646,37 @@ static bool __tmio_mmc_card_detect_irq(struct tmio_mmc_host *host,
 	return false;
 }
 
-static bool __tmio_mmc_sdcard_irq(struct tmio_mmc_host *host, int ireg,
-				  int status)
+static irqreturn_t __tmio_mmc_sdcard_irq(struct tmio_mmc_host *host, int ireg,
+					 int status)
 {
 	/* Command completion */
 	if (ireg & (TMIO_STAT_CMDRESPEND | TMIO_STAT_CMDTIMEOUT)) {
 		tmio_mmc_ack_mmc_irqs(host, TMIO_STAT_CMDRESPEND |
 				      TMIO_STAT_CMDTIMEOUT);
 		tmio_mmc_cmd_irq(host, status);
-		return true;
+		return IRQ_HANDLED;
 	}
 
-	/* Data transfer */
+	/*
+	 * Data transfer: mask the request until the IRQ thread has moved
+	 * the block, so the copy doesn't run with interrupts off.
+	 */
 	if (ireg & (TMIO_STAT_RXRDY | TMIO_STAT_TXRQ)) {
 		tmio_mmc_ack_mmc_irqs(host, TMIO_STAT_RXRDY | TMIO_STAT_TXRQ);
-		tmio_mmc_pio_irq(host);
-		return true;
+		spin_lock(&host->lock);
+		tmio_mmc_disable_mmc_irqs(host, TMIO_STAT_RXRDY | TMIO_STAT_TXRQ);
+		spin_unlock(&host->lock);
+		return IRQ_WAKE_THREAD;
 	}
 
 	/* Data transfer completion */
 	if (ireg & TMIO_STAT_DATAEND) {
 		tmio_mmc_ack_mmc_irqs(host, TMIO_STAT_DATAEND);
 		tmio_mmc_data_irq(host, status);
-		return true;
+		return IRQ_HANDLED;
 	}
 
-	return false;
+	return IRQ_NONE;
 }
 
 static bool __tmio_mmc_sdio_irq(struct tmio_mmc_host *host)
@@ -702,6 +708,7 @@ irqreturn_t tmio_mmc_irq(int irq, void *devid)
 {
 	struct tmio_mmc_host *host = devid;
 	unsigned int ireg, status;
+	irqreturn_t ret;
 
 	status = sd_ctrl_read16_and_16_as_32(host, CTL_STATUS);
 	ireg = status & TMIO_MASK_IRQ & ~host->sdcard_irq_mask;
@@ -711,8 +718,9 @@ irqreturn_t tmio_mmc_irq(int irq, void *devid)
 
 	if (__tmio_mmc_card_detect_irq(host, ireg, status))
 		return IRQ_HANDLED;
-	if (__tmio_mmc_sdcard_irq(host, ireg, status))
-		return IRQ_HANDLED;
+	ret = __tmio_mmc_sdcard_irq(host, ireg, status);
+	if (ret != IRQ_NONE)
+		return ret;
 
 	if (__tmio_mmc_sdio_irq(host))
 		return IRQ_HANDLED;
@@ -721,6 +729,30 @@ irqreturn_t tmio_mmc_irq(int irq, void *devid)
 }
 EXPORT_SYMBOL_GPL(tmio_mmc_irq);
 
+irqreturn_t tmio_mmc_irq_thread(int irq, void *devid)
+{
+	struct tmio_mmc_host *host = devid;
+	unsigned long flags;
+
+	/*
+	 * The data end IRQ and the reset work complete the request under
+	 * host->lock, so hold it while moving the block. That bounds the
+	 * time with interrupts off to a single block.
+	 */
+	spin_lock_irqsave(&host->lock, flags);
+	tmio_mmc_pio_irq(host);
+
+	/* Ask for the next block, unless the request has gone meanwhile */
+	if (host->data && !host->dma_on)
+		tmio_mmc_enable_mmc_irqs(host,
+					 host->data->flags & MMC_DATA_READ ?
+					 TMIO_STAT_RXRDY : TMIO_STAT_TXRQ);
+	spin_unlock_irqrestore(&host->lock, flags);
+
+	return IRQ_HANDLED;
+}
+EXPORT_SYMBOL_GPL(tmio_mmc_irq_thread);
+
 static int tmio_mmc_start_data(struct tmio_mmc_host *host,
 			       struct mmc_data *data)
 {
@@ -81,9 +81,8 @@ static void uniphier_sd_dma_endisable(struct tmio_mmc_host *host, int enable)
 }
 
 /* external DMA engine */
-static void uniphier_sd_external_dma_issue(struct tasklet_struct *t)
+static void uniphier_sd_external_dma_issue(struct tmio_mmc_host *host)
 {
-	struct tmio_mmc_host *host = from_tasklet(host, t, dma_issue);
 	struct uniphier_sd_priv *priv = uniphier_sd_priv(host);
 
 	uniphier_sd_dma_endisable(host, 1);
@@ -189,8 +188,6 @@ static void uniphier_sd_external_dma_request(struct tmio_mmc_host *host,
 	priv->chan = chan;
 	host->chan_rx = chan;
 	host->chan_tx = chan;
-
-	tasklet_setup(&host->dma_issue, uniphier_sd_external_dma_issue);
 }
 
 static void uniphier_sd_external_dma_release(struct tmio_mmc_host *host)
@@ -225,16 +222,12 @@ static const struct tmio_mmc_dma_ops uniphier_sd_external_dma_ops = {
 	.release = uniphier_sd_external_dma_release,
 	.abort = uniphier_sd_external_dma_abort,
 	.dataend = uniphier_sd_external_dma_dataend,
+	.issue = uniphier_sd_external_dma_issue,
 };
 
-static void uniphier_sd_internal_dma_issue(struct tasklet_struct *t)
+static void uniphier_sd_internal_dma_issue(struct tmio_mmc_host *host)
 {
-	struct tmio_mmc_host *host = from_tasklet(host, t, dma_issue);
-	unsigned long flags;
-
-	spin_lock_irqsave(&host->lock, flags);
 	tmio_mmc_enable_mmc_irqs(host, TMIO_STAT_DATAEND);
-	spin_unlock_irqrestore(&host->lock, flags);
 
 	uniphier_sd_dma_endisable(host, 1);
 	writel(UNIPHIER_SD_DMA_CTL_START, host->ctl + UNIPHIER_SD_DMA_CTL);
@@ -307,8 +300,6 @@ static void uniphier_sd_internal_dma_request(struct tmio_mmc_host *host,
 		host->chan_rx = (void *)0xdeadbeaf;
 
 	host->chan_tx = (void *)0xdeadbeaf;
-
-	tasklet_setup(&host->dma_issue, uniphier_sd_internal_dma_issue);
 }
 
 static void uniphier_sd_internal_dma_release(struct tmio_mmc_host *host)
@@ -349,6 +340,7 @@ static const struct tmio_mmc_dma_ops uniphier_sd_internal_dma_ops = {
 	.release = uniphier_sd_internal_dma_release,
 	.abort = uniphier_sd_internal_dma_abort,
 	.dataend = uniphier_sd_internal_dma_dataend,
+	.issue = uniphier_sd_internal_dma_issue,
 };
 
 static int uniphier_sd_clk_enable(struct tmio_mmc_host *host)
@@ -637,8 +629,9 @@ static int uniphier_sd_probe(struct platform_device *pdev)
 	if (ret)
 		goto disable_clk;
 
-	ret = devm_request_irq(dev, irq, tmio_mmc_irq, IRQF_SHARED,
-			       dev_name(dev), host);
+	ret = devm_request_threaded_irq(dev, irq, tmio_mmc_irq,
+					tmio_mmc_irq_thread, IRQF_SHARED,
+					dev_name(dev), host);
 	if (ret)
 		goto remove_host;
 
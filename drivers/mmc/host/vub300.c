@@ -50,6 +50,8 @@
 #include <linux/firmware.h>
 #include <linux/scatterlist.h>
 
+#include "mmc_hsq.h"
+
 struct host_controller_info {
 	u8 info_size;
 	u16 firmware_version;
@@ -349,9 +351,16 @@ struct vub300_mmc_host {
 	struct delayed_work pollwork;
 	struct host_controller_info hc_info;
 	struct sd_status_header system_port_status;
+	struct mmc_hsq hsq;
 	u8 padded_buffer[64];
 };
 
+/*
+ * Padded writes are split over this many bulk URBs, so the host controller
+ * always has the next one queued while the current one is on the wire.
+ */
+#define VUB300_DATA_URBS 4
+
 #define kref_to_vub300_mmc_host(d) container_of(d, struct vub300_mmc_host, kref)
 #define SET_TRANSFER_PSEUDOCODE		21
 #define SET_INTERRUPT_PSEUDOCODE	20
@@ -382,6 +391,18 @@ static void vub300_delete(struct kref *kref)
 	 */
 }
 
+static void vub300_request_done(struct mmc_host *mmc, struct mmc_request *req)
+{
+	/*
+	 * With the software queue enabled this also starts the next queued
+	 * request, without a round trip through the block layer
+	 */
+	if (mmc_hsq_finalize_request(mmc, req))
+		return;
+
+	mmc_request_done(mmc, req);
+}
+
 static void vub300_queue_cmnd_work(struct vub300_mmc_host *vub300)
 {
 	kref_get(&vub300->kref);
@@ -1499,6 +1520,35 @@ static int __command_read_data(struct vub300_mmc_host *vub300,
 	}
 }
 
+static int vub300_usb_bulk_write_chunked(struct vub300_mmc_host *vub300,
+					 unsigned int pipe, u8 *buf, int len,
+					 int timeout_msecs)
+{
+	/* cmd_mutex is held by vub300_cmndwork_thread */
+	struct scatterlist sg[VUB300_DATA_URBS];
+	int chunk = ALIGN(DIV_ROUND_UP(len, VUB300_DATA_URBS), 512);
+	int nents = 0;
+	int offset;
+	int result;
+
+	sg_init_table(sg, VUB300_DATA_URBS);
+	for (offset = 0; offset < len; offset += chunk)
+		sg_set_buf(&sg[nents++], buf + offset,
+			   min(chunk, len - offset));
+	sg_mark_end(&sg[nents - 1]);
+
+	result = usb_sg_init(&vub300->sg_request, vub300->udev, pipe, 0,
+			     sg, nents, 0, GFP_KERNEL);
+	if (result < 0)
+		return result;
+	vub300->sg_transfer_timer.expires =
+		jiffies + msecs_to_jiffies(timeout_msecs);
+	add_timer(&vub300->sg_transfer_timer);
+	usb_sg_wait(&vub300->sg_request);
+	del_timer(&vub300->sg_transfer_timer);
+	return vub300->sg_request.status;
+}
+
 static int __command_write_data(struct vub300_mmc_host *vub300,
 				struct mmc_command *cmd, struct mmc_data *data)
 {
@@ -1533,14 +1583,13 @@ static int __command_write_data(struct vub300_mmc_host *vub300,
 		u8 *buf = kmalloc(padded_length, GFP_KERNEL);
 		if (buf) {
 			int result;
-			int actual_length;
 			sg_copy_to_buffer(data->sg, data->sg_len, buf,
 					  padded_length);
 			memset(buf + linear_length, 0,
 			       padded_length - linear_length);
 			result =
-				vub300_usb_bulk_msg(vub300, pipe, buf,
-						    padded_length, &actual_length,
+				vub300_usb_bulk_write_chunked(vub300, pipe, buf,
+						    padded_length,
 						    2000 + padded_length / 16384);
 			kfree(buf);
 			if (result < 0) {
@@ -1777,7 +1826,7 @@ static void vub300_cmndwork_thread(struct work_struct *work)
 			if (cmd->error == -ENOMEDIUM)
 				check_vub300_port_status(vub300);
 			mutex_unlock(&vub300->cmd_mutex);
-			mmc_request_done(vub300->mmc, req);
+			vub300_request_done(vub300->mmc, req);
 			kref_put(&vub300->kref, vub300_delete);
 			return;
 		} else {
@@ -1785,7 +1834,7 @@ static void vub300_cmndwork_thread(struct work_struct *work)
 			vub300->resp_len = 0;
 			mutex_unlock(&vub300->cmd_mutex);
 			kref_put(&vub300->kref, vub300_delete);
-			mmc_request_done(vub300->mmc, req);
+			vub300_request_done(vub300->mmc, req);
 			return;
 		}
 	}
@@ -1901,28 +1950,28 @@ static void vub300_mmc_request(struct mmc_host *mmc, struct mmc_request *req)
 	struct vub300_mmc_host *vub300 = mmc_priv(mmc);
 	if (!vub300->interface) {
 		cmd->error = -ESHUTDOWN;
-		mmc_request_done(mmc, req);
+		vub300_request_done(mmc, req);
 		return;
 	} else {
 		struct mmc_data *data = req->data;
 		if (!vub300->card_powered) {
 			cmd->error = -ENOMEDIUM;
-			mmc_request_done(mmc, req);
+			vub300_request_done(mmc, req);
 			return;
 		}
 		if (!vub300->card_present) {
 			cmd->error = -ENOMEDIUM;
-			mmc_request_done(mmc, req);
+			vub300_request_done(mmc, req);
 			return;
 		}
 		if (vub300->usb_transport_fail) {
 			cmd->error = vub300->usb_transport_fail;
-			mmc_request_done(mmc, req);
+			vub300_request_done(mmc, req);
 			return;
 		}
 		if (!vub300->interface) {
 			cmd->error = -ENODEV;
-			mmc_request_done(mmc, req);
+			vub300_request_done(mmc, req);
 			return;
 		}
 		kref_get(&vub300->kref);
@@ -1937,7 +1986,7 @@ static void vub300_mmc_request(struct mmc_host *mmc, struct mmc_request *req)
 			cmd->error = 0;
 			mutex_unlock(&vub300->cmd_mutex);
 			kref_put(&vub300->kref, vub300_delete);
-			mmc_request_done(mmc, req);
+			vub300_request_done(mmc, req);
 			return;
 		} else {
 			vub300->cmd = cmd;
@@ -2169,6 +2218,9 @@ static int vub300_probe(struct usb_interface *interface,
 	mmc->ops = &vub300_mmc_ops;
 	vub300 = mmc_priv(mmc);
 	vub300->mmc = mmc;
+	retval = mmc_hsq_init(&vub300->hsq, mmc);
+	if (retval)
+		goto error5;
 	vub300->card_powered = 0;
 	vub300->bus_width = 0;
 	vub300->cmnd.head.block_size[0] = 0x00;
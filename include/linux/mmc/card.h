@@ -83,7 +83,10 @@ struct mmc_ext_csd {
 	bool			man_bkops_en;	/* manual bkops enable bit */
 	bool			auto_bkops_en;	/* auto bkops enable bit */
 	unsigned int            data_sector_size;       /* 512 bytes or 4KB */
+	unsigned int		native_sector_size;	/* 512 bytes or 4KB */
 	unsigned int            data_tag_unit_size;     /* DATA TAG UNIT size */
+	u8			max_context_id;
+	u8			nr_contexts;	/* Contexts open for mmcblk */
 	unsigned int		boot_ro_lock;		/* ro lock support */
 	bool			boot_ro_lockable;
 	bool			ffu_capable;	/* Firmware upgrade support */
@@ -93,6 +96,7 @@ struct mmc_ext_csd {
 #define MMC_FIRMWARE_LEN 8
 	u8			fwrev[MMC_FIRMWARE_LEN];  /* FW version */
 	u8			raw_exception_status;	/* 54 */
+	u8			raw_use_native_sector;	/* 62 */
 	u8			raw_partition_support;	/* 160 */
 	u8			raw_rpmb_size_mult;	/* 168 */
 	u8			raw_erased_mem_count;	/* 181 */
@@ -301,6 +305,7 @@ struct mmc_part {
 #define MMC_BLK_DATA_AREA_BOOT	(1<<1)
 #define MMC_BLK_DATA_AREA_GP	(1<<2)
 #define MMC_BLK_DATA_AREA_RPMB	(1<<3)
+#define MMC_BLK_DATA_AREA_ENH	(1<<4)	/* Enhanced window of the user area */
 };
 
 /*
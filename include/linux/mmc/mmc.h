@@ -259,9 +259,12 @@ static inline bool mmc_ready_for_data(u32 status)
 #define EXT_CSD_POWER_OFF_NOTIFICATION	34	/* R/W */
 #define EXT_CSD_PACKED_FAILURE_INDEX	35	/* RO */
 #define EXT_CSD_PACKED_CMD_STATUS	36	/* RO */
+#define EXT_CSD_CONTEXT_CONF		37	/* R/W, 15 bytes */
 #define EXT_CSD_EXP_EVENTS_STATUS	54	/* RO, 2 bytes */
 #define EXT_CSD_EXP_EVENTS_CTRL		56	/* R/W, 2 bytes */
 #define EXT_CSD_DATA_SECTOR_SIZE	61	/* R */
+#define EXT_CSD_USE_NATIVE_SECTOR	62	/* R/W */
+#define EXT_CSD_NATIVE_SECTOR_SIZE	63	/* R */
 #define EXT_CSD_GP_SIZE_MULT		143	/* R/W */
 #define EXT_CSD_PARTITION_SETTING_COMPLETED 155	/* R/W */
 #define EXT_CSD_PARTITION_ATTRIBUTE	156	/* R/W */
@@ -306,6 +309,7 @@ static inline bool mmc_ready_for_data(u32 status)
 #define EXT_CSD_PWR_CL_200_195		236	/* RO */
 #define EXT_CSD_PWR_CL_200_360		237	/* RO */
 #define EXT_CSD_PWR_CL_DDR_52_195	238	/* RO */
+#define EXT_CSD_CONTEXT_CAPABILITIES	238	/* RO */
 #define EXT_CSD_PWR_CL_DDR_52_360	239	/* RO */
 #define EXT_CSD_BKOPS_STATUS		246	/* RO */
 #define EXT_CSD_POWER_OFF_LONG_TIME	247	/* RO */
@@ -404,6 +408,10 @@ static inline bool mmc_ready_for_data(u32 status)
 
 #define EXT_CSD_PACKED_EVENT_EN	BIT(3)
 
+#define EXT_CSD_MAX_CONTEXT_ID_MASK	0x0F
+#define EXT_CSD_CONTEXT_CLOSED		0
+#define EXT_CSD_CONTEXT_RW		3	/* Read/write context */
+
 /*
  * EXCEPTION_EVENT_STATUS field
  */